@@ -1,8 +1,12 @@
 ﻿#include "App.h"
 
 #include <algorithm>
+#include <bitset>
+#include <cctype>
 #include <chrono>
-#include <iostream>
+#include <csignal>
+#include <functional>
+#include <memory>
 
 #include <restbed>
 #include <utility>
@@ -10,10 +14,44 @@
 
 #include <regex>
 
+#include "Logger.h"
+
 namespace app
 {
+    namespace
+    {
+        std::string MakeETag(uint64_t version, const std::string& key)
+        {
+            return fmt::format("\"{:x}-{:x}\"", version, std::hash<std::string>()(key));
+        }
+
+        // If-None-Match: "*" or list of ETags, weak comparison
+        bool MatchETag(const std::string& ifNoneMatch, const std::string& etag)
+        {
+            size_t pos = 0;
+            while (pos < ifNoneMatch.size())
+            {
+                size_t end = std::min(ifNoneMatch.find(',', pos), ifNoneMatch.size());
+                std::string item = ifNoneMatch.substr(pos, end - pos);
+                item.erase(0, item.find_first_not_of(" \t"));
+                item.erase(item.find_last_not_of(" \t") + 1);
+                if (item.compare(0, 2, "W/") == 0)
+                    item.erase(0, 2);
+
+                if (item == "*" || item == etag)
+                    return true;
+                pos = end + 1;
+            }
+            return false;
+        }
+    } // namespace
+
     App::App(AppOptions&& options)
         : _options(std::forward<AppOptions>(options))
+        , _metrics(Metrics::Instance())
+        , _flagWriter(_db, _asyncDb)
+        , _devices(64, _options.App.device_filter_capacity)
+        , _responseCache(_options.App.cache_max_bytes)
     {
     }
 
@@ -21,38 +59,79 @@ namespace app
     {
         using namespace std::placeholders;
 
+        LoadFlagRules();
         _db.Connect(_options.DB);
 
-        // Get devices from DB
-        _devicesIds = _db.ReadDevicesNames();
+        if (_options.DB.purge_orphan_flags)
+        {
+            // One-shot maintenance command
+            size_t purged = _db.PurgeOrphanFlags();
+            LOG_INFO("Purge orphan flags", "purged", purged);
+            return;
+        }
+
+        _asyncDb.Connect(_options.DB);
+        _flagWriter.Start(_options.DB);
+
+        // Listen before loading: changes committed during the load are applied again, that's idempotent
+        _devicesListener.Start(_options.DB, _db.InstanceId(), [this](const DevicesChange& change) { OnDevicesChange(change); });
+
+        // Load devices state from DB
+        LoadDevices();
                        
         _service = std::make_shared<restbed::Service>();
         PublishResources();
 
         auto settings = std::make_shared<restbed::Settings>();
         settings->set_port((uint16_t)_options.App.port);
-        settings->set_default_header("Connection", "close");
         settings->set_worker_limit(_options.App.worker_count);
+        settings->set_connection_timeout(std::chrono::seconds(_options.App.keep_alive_timeout));
 
 
-        _mqtt.SetDevMessageCallback([service = _service, onDevMessage = std::bind(&App::OnMqttDevMessage, this, _1)](DevParam devParam)
+        // Ingest runs on its own workers, off the REST runloop
+        _ingestQueue.Start(_options.App, [this](const IngestQueue::Batch& batch) { OnMqttDevMessages(batch); });
+        _mqtt.SetDeviceFilter(&_devices.Filter());
+        _mqtt.SetDevMessageCallback([this](const DevMessage& message)
         {
-            service->schedule(std::bind(onDevMessage, std::move(devParam)));
+            _ingestQueue.Push(message);
         });
         _mqtt.Connect(_options.MQTT);
         _mqtt.Start();
 
+        // Graceful shutdown: stop ingest, then drain pending flags to DB
+        auto onStopSignal = [service = _service](const int signal)
+        {
+            LOG_INFO("Stop by signal", "signal", signal);
+            service->stop();
+        };
+        _service->set_signal_handler(SIGINT,  onStopSignal);
+        _service->set_signal_handler(SIGTERM, onStopSignal);
+
+        // Reload flag rules without restart, invalid rules keep the current ones
+        _service->set_signal_handler(SIGHUP, [this](const int)
+        {
+            try
+            {
+                LoadFlagRules();
+            }
+            catch (std::exception& ex)
+            {
+                LOG_ERROR("Reload flag rules: FAILED", "error", ex.what());
+            }
+        });
+
         _service->start(settings);
+
+        _mqtt.Stop();
+        _ingestQueue.Stop();
+        _devicesListener.Stop();
+        _flagWriter.Stop();
+        _asyncDb.Stop();
     }
 
     void App::PublishResources()
     {
         using namespace std::placeholders;
-        std::multimap<std::string, std::string> jsonFilters =
-        {
-            { "Accept",       "application/json" },
-            { "Content-Type", "application/json" }
-        };
         
         // GET/POST/DELETE devices
         {
@@ -63,59 +142,202 @@ namespace app
                     "/devices/{deviceID: .*}"
                 });
 
-            resource->set_method_handler("GET",    jsonFilters, std::bind(&App::HTTP_GET_Devices,    this, _1));
-            resource->set_method_handler("POST",   jsonFilters, std::bind(&App::HTTP_POST_Devices,   this, _1));
-            resource->set_method_handler("DELETE", jsonFilters, std::bind(&App::HTTP_DELETE_Devices, this, _1));
+            // Content negotiation: handler per encoding
+            for (Encoding encoding : { Encoding::Json, Encoding::Cbor, Encoding::MsgPack })
+            {
+                std::multimap<std::string, std::string> filters =
+                {
+                    { "Accept",       GetContentTypeFilter(encoding) },
+                    { "Content-Type", GetContentTypeFilter(encoding) }
+                };
+
+                resource->set_method_handler("GET",    filters, TimedHandler(HttpMethod::Get,    std::bind(&App::HTTP_GET_Devices,    this, _1, encoding)));
+                resource->set_method_handler("POST",   filters, TimedHandler(HttpMethod::Post,   std::bind(&App::HTTP_POST_Devices,   this, _1, encoding)));
+                resource->set_method_handler("DELETE", filters, TimedHandler(HttpMethod::Delete, std::bind(&App::HTTP_DELETE_Devices, this, _1, encoding)));
+            }
+
+            _service->publish(resource);
+        }
+
+        // GET metrics
+        {
+            auto resource = std::make_shared<restbed::Resource>();
+            resource->set_path("/metrics");
+            resource->set_method_handler("GET", std::bind(&App::HTTP_GET_Metrics, this, _1));
 
             _service->publish(resource);
         }
     }
 
-    void App::HTTP_GET_Devices(SharedSession session)
+    std::function<void(SharedSession)> App::TimedHandler(HttpMethod method, std::function<void(SharedSession)> handler)
     {
-        using namespace std::chrono;
-        auto timestampSeconds = duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+        // Time until the handler returns, async parts of the response (fetch, streaming) aren't included
+        Histogram& latency = _metrics.httpHandlerLatency[static_cast<size_t>(method)];
+        return [&latency, handler = std::move(handler)](SharedSession session)
+        {
+            ScopedTimer timer(latency);
+            handler(std::move(session));
+        };
+    }
 
-        std::vector<Device> devices;
+    void App::HTTP_GET_Devices(SharedSession session, Encoding encoding)
+    {
+        size_t threshold = _options.App.change_timestamp_threshold;
 
+        // Compact by default, pretty JSON on request: ?pretty=true
         const auto request = session->get_request();
+        const auto pretty = request->get_query_parameter("pretty");
+        int indent = (pretty == "true" || pretty == "1") ? 4 : -1;
+
+        std::string error;
+        uint64_t timestamp;
+        if (!ReadReferenceTimestamp(*request, timestamp, error))
+        {
+            SessionReply_TEXT(session, restbed::BAD_REQUEST, error);
+            return;
+        }
+
+        // The response depends on the key and the registry version
+        std::string cacheKey = fmt::format("{}|{}|{}|{}", static_cast<int>(encoding), indent, timestamp, request->get_path());
+        for (const auto& it : request->get_query_parameters())
+            cacheKey += '|' + it.first + '=' + it.second;
+
+        std::multimap<std::string, std::string> headers = {
+            {"Content-Type", GetContentType(encoding)},
+            {"Vary",         "Accept"}
+        };
+
         if (request->has_path_parameter("deviceID"))
         {
             std::string deviceId = request->get_path_parameter("deviceID");
-            std::cout << "Get deviceID: " << deviceId << std::endl;
-            devices = GetDevice(deviceId);
+            LOG_DEBUG("Get device", "device", deviceId);
+
+            // Missing device changes with the registry only
+            uint64_t version = _devices.Version();
+            std::vector<Device> devices = GetDevice(deviceId);
+            if (!devices.empty())
+                version = devices.front().version;
+
+            auto etag = MakeETag(version, cacheKey);
+            if (SessionNotModified(session, etag))
+                return;
+
+            // Calc changeTimestamp and dynamic flag
+            for (auto& device : devices)
+            {
+                device.CalcChangeTimestamps(timestamp);
+                device.CalcDynamicFlags(threshold);
+            }
+
+            json jsonData{ {"devices",devices}, };
+            headers.emplace("ETag", etag);
+            SessionReply(session, restbed::OK, Serialize(jsonData, encoding, indent), std::move(headers));
+            return;
         }
-        else
+
+        LOG_DEBUG("Get all devices");
+
+        DeviceQuery query;
+        if (!ReadDeviceQuery(*request, query, error))
         {
-            std::cout << "Get all devices" << std::endl;
-            devices = GetAllDevices();
+            SessionReply_TEXT(session, restbed::BAD_REQUEST, error);
+            return;
         }
 
-        // Calc changeTimestamp
-        for (auto& device : devices)
-            for (auto& it : device.flags)
-            {
-                auto& flag = it.second;
-                if (flag.value == true)
-                    flag.changeTimestamp = timestampSeconds - flag.timestamp;
-            }        
+        uint64_t version = _devices.Version();
+        auto etag = MakeETag(version, cacheKey);
+        if (SessionNotModified(session, etag))
+            return;
 
-        // Calc dynamic flag
-        size_t threshold = _options.App.change_timestamp_threshold;
-        for (auto& device : devices)
+        headers.emplace("ETag", etag);
+        if (auto body = _responseCache.Get(cacheKey, version))
         {
-            device.CalcDynamicFlags(threshold);
+            ++_metrics.httpCacheHits;
+            SessionReply(session, restbed::OK, *body, std::move(headers));
+            return;
         }
+        ++_metrics.httpCacheMisses;
+
+        if (encoding != Encoding::MsgPack)
+        {
+            // Stream page by page with chunked transfer encoding
+            auto response = std::make_shared<StreamedResponse>();
+            response->stream    = std::make_shared<DevicesStream>(_devices, std::move(query), timestamp, threshold, encoding, indent);
+            response->keepAlive = SessionKeepAlive(session);
+            response->cacheKey  = std::move(cacheKey);
+            response->version   = version;
+
+            auto connectionHeaders = ConnectionHeaders(response->keepAlive);
+            headers.insert(connectionHeaders.begin(), connectionHeaders.end());
+            headers.emplace("Transfer-Encoding", "chunked");
+            session->yield(restbed::OK, headers,
+                [this, response](const SharedSession s) { SessionStream_Chunks(s, response); });
+            return;
+        }
+
+        // MessagePack needs the devices count up front
+        DeviceCursor cursor(_devices, std::move(query), timestamp, threshold);
+        std::vector<Device> devices;
+        Device device;
+        while (cursor.Next(device))
+            devices.push_back(std::move(device));
 
-        // Devices to JSON
         json jsonData{ {"devices",devices}, };
-        std::string strJson = jsonData.dump(4);
-        SessionClose_JSON(session, restbed::OK, jsonData.dump(4));
+        if (auto next = cursor.GetNextAfter())
+            jsonData["next"] = *next;
+
+        std::string body = Serialize(jsonData, encoding, indent);
+        _responseCache.Put(cacheKey, version, body);
+        SessionReply(session, restbed::OK, body, std::move(headers));
     }
 
-    void App::HTTP_POST_Devices(SharedSession session)
+    bool App::ReadReferenceTimestamp(const restbed::Request& request, uint64_t& timestamp, std::string& error)
     {
-        static std::string jsonDevicesIdsKey = "devicesIds";
+        // Explicit: ?at=<unix time, s>
+        if (request.has_query_parameter("at"))
+        {
+            auto str = request.get_query_parameter("at");
+            try
+            {
+                size_t pos = 0;
+                timestamp = std::stoull(str, &pos);
+                if (pos != str.size())
+                    throw std::invalid_argument(str);
+            }
+            catch (std::exception&)
+            {
+                error = "Bad Request, at: expected unix time, s";
+                return false;
+            }
+            return true;
+        }
+
+        // Now, rounded down to the time bucket, so responses are cacheable within the bucket
+        using namespace std::chrono;
+        timestamp = duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+        size_t bucket = _options.App.cache_time_bucket;
+        if (bucket > 1)
+            timestamp -= timestamp % bucket;
+        return true;
+    }
+
+    void App::HTTP_POST_Devices(SharedSession session, Encoding encoding)
+    {
+        auto createDevices = [this, encoding](const SharedSession& s, std::set<std::string> devicesIds)
+        {
+            size_t requested = devicesIds.size();
+            try
+            {
+                size_t created = CreateDevices(std::move(devicesIds));
+                json jsonResult{ {"created", created}, {"existing", requested - created} };
+                SessionReply_Encoded(s, restbed::OK, jsonResult, encoding);
+            }
+            catch (std::exception& ex)
+            {
+                LOG_ERROR("Create devices error", "error", ex.what());
+                SessionReply_TEXT(s, restbed::INTERNAL_SERVER_ERROR, "Internal Server Error");
+            }
+        };
 
         const auto request = session->get_request();
         std::size_t length = request->get_header<size_t>("Content-Length", 0);
@@ -125,48 +347,47 @@ namespace app
             {
                 // Single device from path parameter
                 std::string deviceId = request->get_path_parameter("deviceID");
-                CreateDevices({ deviceId });
-                session->close(restbed::OK);
+                createDevices(session, { deviceId });
             }
             else
             {
-                SessionClose_TEXT(session, restbed::NOT_ACCEPTABLE, "Not Acceptable, empty body");
+                SessionReply_TEXT(session, restbed::NOT_ACCEPTABLE, "Not Acceptable, empty body");
             }
         }
         else
         {
-            session->fetch(length, [this](SharedSession s, const restbed::Bytes &data)
+            session->fetch(length, [this, encoding, createDevices](SharedSession s, const restbed::Bytes &data)
             {
-                // Devices from JSON
-                json jsonData;
-                try
-                {
-                    jsonData = json::parse(data);
-                }
-                catch (std::exception& ex)
-                {
-                    std::cout << "JSON parse error: " << ex.what() << std::endl;
-                    s->close(restbed::BAD_REQUEST);
-                    return;
-                }
-
-                if (!jsonData.contains(jsonDevicesIdsKey))
+                std::set<std::string> devices;
+                if (!ReadDevicesIds(data, encoding, devices))
                 {
-                    std::cout << fmt::format("JSON no key: \"{}\"", jsonDevicesIdsKey) << std::endl;
-                    s->close(restbed::BAD_REQUEST);
+                    SessionReply(s, restbed::BAD_REQUEST);
                     return;
                 }
 
-                auto devices = jsonData[jsonDevicesIdsKey].get<std::set<std::string>>();
-                CreateDevices(std::move(devices));
-                s->close(restbed::OK);
+                createDevices(s, std::move(devices));
             });
         }
     }
 
-    void App::HTTP_DELETE_Devices(SharedSession session)
+    void App::HTTP_DELETE_Devices(SharedSession session, Encoding encoding)
     {
-        static std::string jsonDevicesIdsKey = "devicesIds";
+        auto deleteDevices = [this](const SharedSession& s, std::set<std::string> devicesIds, bool all)
+        {
+            try
+            {
+                if (all)
+                    DeleteAllDevices();
+                else
+                    DeleteDevices(std::move(devicesIds));
+                SessionReply(s, restbed::OK);
+            }
+            catch (std::exception& ex)
+            {
+                LOG_ERROR("Delete devices error", "error", ex.what());
+                SessionReply_TEXT(s, restbed::INTERNAL_SERVER_ERROR, "Internal Server Error");
+            }
+        };
 
         const auto request = session->get_request();
         std::size_t length = request->get_header<size_t>("Content-Length", 0);
@@ -176,216 +397,462 @@ namespace app
             {
                 // Single device from path parameter
                 std::string deviceId = request->get_path_parameter("deviceID");
-                DeleteDevices({ deviceId });
-                session->close(restbed::OK);
+                deleteDevices(session, { deviceId }, false);
             }
             else
             {
-                DeleteAllDevices();
-                session->close(restbed::OK);
+                deleteDevices(session, {}, true);
             }
         }
         else
         {
-            session->fetch(length, [this](SharedSession s, const restbed::Bytes &data)
+            session->fetch(length, [this, encoding, deleteDevices](SharedSession s, const restbed::Bytes &data)
             {
-                // Devices from JSON
-                json jsonData;
-                try
-                {
-                    jsonData = json::parse(data);
-                }
-                catch (std::exception& ex)
+                std::set<std::string> devices;
+                if (!ReadDevicesIds(data, encoding, devices))
                 {
-                    std::cout << "JSON parse error: " << ex.what() << std::endl;
-                    s->close(restbed::BAD_REQUEST);
+                    SessionReply(s, restbed::BAD_REQUEST);
                     return;
                 }
 
-                if (!jsonData.contains(jsonDevicesIdsKey))
-                {
-                    std::cout << fmt::format("JSON no key: \"{}\"", jsonDevicesIdsKey) << std::endl;
-                    s->close(restbed::BAD_REQUEST);
-                    return;
-                }
-
-                auto devices = jsonData[jsonDevicesIdsKey].get<std::set<std::string>>();
-                DeleteDevices(std::move(devices));
-                s->close(restbed::OK);
+                deleteDevices(s, std::move(devices), false);
             });
         }
     }
 
-    void App::CreateDevices(std::set<std::string> devicesIds)
+    bool App::ReadDeviceQuery(const restbed::Request& request, DeviceQuery& query, std::string& error)
     {
-        std::lock_guard<std::shared_timed_mutex> lock(_syncDevices);
+        auto readBool = [&request, &error](const std::string& name, bool& value)
+        {
+            auto str = request.get_query_parameter(name);
+            if (str == "true" || str == "1")
+                value = true;
+            else if (str == "false" || str == "0")
+                value = false;
+            else
+            {
+                error = fmt::format("Bad Request, {}: expected true or false", name);
+                return false;
+            }
+            return true;
+        };
 
-        std::set<std::string> addDevices;
-        std::set_difference(
-            devicesIds.begin(), devicesIds.end(),
-            _devicesIds.begin(), _devicesIds.end(),
-            std::inserter(addDevices, addDevices.end()));
+        // Keyset pagination: ?limit=100&after=<last device of previous page>
+        if (request.has_query_parameter("after"))
+        {
+            query.hasAfter = true;
+            query.after = request.get_query_parameter("after");
+        }
+        if (request.has_query_parameter("limit"))
+        {
+            auto str = request.get_query_parameter("limit");
+            try
+            {
+                size_t pos = 0;
+                query.limit = std::stoull(str, &pos);
+                if (pos != str.size() || query.limit == 0)
+                    throw std::invalid_argument(str);
+            }
+            catch (std::exception&)
+            {
+                error = "Bad Request, limit: expected positive number";
+                return false;
+            }
+        }
 
-        std::cout << "Create new devicesIds:" << std::endl;
-        for (auto& devName : addDevices)
+        // Filters: ?prefix=dev&acceptanceResult=false&flag1=true
+        query.prefix = request.get_query_parameter("prefix");
+        if (request.has_query_parameter("acceptanceResult"))
         {
-            std::cout << "\t" << devName << std::endl;
+            query.hasAcceptanceResult = true;
+            if (!readBool("acceptanceResult", query.acceptanceResult))
+                return false;
         }
-        std::cout << std::endl;
+        for (size_t i = 0; i < FlagCount; ++i)
+        {
+            const std::string flagName = FlagTable[i].name;
+            if (!request.has_query_parameter(flagName))
+                continue;
+
+            bool value;
+            if (!readBool(flagName, value))
+                return false;
+            query.flags.emplace_back(i, value);
+        }
+        return true;
+    }
 
-        // Add devices to DB
-        Device device;
-        for (auto& deviceName : addDevices)
+    bool App::ReadDevicesIds(const restbed::Bytes& data, Encoding encoding, std::set<std::string>& devicesIds)
+    {
+        static std::string devicesIdsKey = "devicesIds";
+
+        try
+        {
+            json jsonData = Deserialize(data, encoding);
+            if (!jsonData.contains(devicesIdsKey))
+            {
+                LOG_WARNING("Body no key", "key", devicesIdsKey);
+                return false;
+            }
+
+            devicesIds = jsonData[devicesIdsKey].get<std::set<std::string>>();
+            return true;
+        }
+        catch (std::exception& ex)
         {
-            device.name = deviceName;
-            _db.CreateDevice(device);
+            LOG_WARNING("Body parse error", "error", ex.what());
+            return false;
         }
+    }
+
+    void App::LoadDevices()
+    {
+        std::lock_guard<std::mutex> lock(_syncProvisioning);
 
-        _devicesIds.insert(addDevices.begin(), addDevices.end());
+        _devices.Reset(_db.ReadDevices());
+        LOG_INFO("Load devices", "count", _devices.Size());
     }
 
-    void App::DeleteDevices(std::set<std::string> devicesIds)
+    size_t App::CreateDevices(std::set<std::string> devicesIds)
     {
-        std::lock_guard<std::shared_timed_mutex> lock(_syncDevices);
+        std::lock_guard<std::mutex> lock(_syncProvisioning);
+
+        // DB decides what's new: devices of other instances may not be in the registry yet
+        std::vector<std::string> addDevices(devicesIds.begin(), devicesIds.end());
+        size_t created = _db.CreateDevices(addDevices);
+        LOG_INFO("Create devices", "requested", addDevices.size(), "new", created);
+
+        // Devices existing in DB keep their flags, devices in the registry keep their state
+        for (auto& device : _db.ReadDevices(addDevices))
+        {
+            LOG_DEBUG("Create device", "device", device.name);
+            _devices.Insert(std::move(device));
+        }
+        return created;
+    }
 
-        std::set<std::string> deleteDevices;
-        std::set_intersection(
-            devicesIds.begin(), devicesIds.end(),
-            _devicesIds.begin(), _devicesIds.end(),
-            std::inserter(deleteDevices, deleteDevices.end()));
+    void App::DeleteDevices(std::set<std::string> devicesIds)
+    {
+        std::lock_guard<std::mutex> lock(_syncProvisioning);
 
-        std::cout << "Delete devicesIds:" << std::endl;
+        // Also devices of other instances that aren't in the registry yet
+        std::vector<std::string> deleteDevices(devicesIds.begin(), devicesIds.end());
+        LOG_INFO("Delete devices", "requested", deleteDevices.size());
         for (auto& devName : deleteDevices)
         {
-            std::cout << "\t" << devName << std::endl;
+            LOG_DEBUG("Delete device", "device", devName);
         }
-        std::cout << std::endl;
 
-        // Delete devices from DB
+        // Delete devices from DB in one statement, then from registry
+        _db.DeleteDevices(deleteDevices);
         for (auto& deviceName : deleteDevices)
         {
-            _db.DeleteDevice(deviceName);
+            _devices.Erase(deviceName);
+            _flagWriter.Discard(deviceName);
         }
-
-        std::set<std::string> remainingDevices;
-        std::set_difference(
-            _devicesIds.begin(), _devicesIds.end(),
-            deleteDevices.begin(), deleteDevices.end(),
-            std::inserter(remainingDevices, remainingDevices.end()));
-        _devicesIds = std::move(remainingDevices);
     }
 
     void App::DeleteAllDevices()
     {
-        std::lock_guard<std::shared_timed_mutex> lock(_syncDevices);
+        std::lock_guard<std::mutex> lock(_syncProvisioning);
 
-        std::cout << "Delete all devices" << std::endl;
+        LOG_INFO("Delete all devices");
         
-        // Delete devices from DB
-        for (auto& deviceName : _devicesIds)
-        {
-            _db.DeleteDevice(deviceName);
-        }
-        _devicesIds.clear();
+        // Delete devices from DB, then from registry
+        _db.DeleteAllDevices();
+        _devices.Reset({});
+        _flagWriter.DiscardAll();
     }
 
-    std::vector<Device> App::GetDevice(std::string deviceId)
+    void App::OnDevicesChange(const DevicesChange& change)
     {
-        std::shared_lock<std::shared_timed_mutex> lock(_syncDevices);
+        std::lock_guard<std::mutex> lock(_syncProvisioning);
 
-        auto it = _devicesIds.find(deviceId);
-        if (it == _devicesIds.end())
-            return {};
+        switch (change.op)
+        {
+        case DevicesChange::Op::Create:
+            // State from DB: the other instance may have created only some of them
+            for (auto& device : _db.ReadDevices(change.deviceNames))
+                _devices.Insert(std::move(device));
+            break;
+
+        case DevicesChange::Op::Delete:
+            for (auto& deviceName : change.deviceNames)
+            {
+                _devices.Erase(deviceName);
+                _flagWriter.Discard(deviceName);
+            }
+            break;
 
-        Device device = _db.ReadDevice(deviceId);
-        return { device };
+        case DevicesChange::Op::DeleteAll:
+            _devices.Reset({});
+            _flagWriter.DiscardAll();
+            break;
+
+        case DevicesChange::Op::Sync:
+            SyncDevices();
+            break;
+        }
+        LOG_INFO("Devices change of another instance", "op", ToString(change.op), "devices", change.deviceNames.size());
     }
 
-    std::vector<Device> App::GetAllDevices()
+    void App::SyncDevices()
     {
-        std::shared_lock<std::shared_timed_mutex> lock(_syncDevices);
+        std::map<std::string, Device> dbDevices;
+        for (auto& device : _db.ReadDevices())
+        {
+            auto deviceName = device.name;
+            dbDevices.emplace(std::move(deviceName), std::move(device));
+        }
 
-        std::vector<Device> devices;
-        devices.reserve(_devicesIds.size());
+        // Registry devices missing in DB, by pages under the shard locks
+        std::vector<std::string> eraseDevices;
+        std::string after;
+        for (bool first = true; ; first = false)
+        {
+            auto page = _devices.GetPage(first ? nullptr : &after, "", 1000);
+            if (page.empty())
+                break;
+            for (auto& device : page)
+            {
+                if (dbDevices.erase(device.name) == 0)
+                    eraseDevices.push_back(device.name);
+            }
+            after = page.back().name;
+        }
 
-        for (auto deviceId : _devicesIds)
+        for (auto& deviceName : eraseDevices)
         {
-            Device device = _db.ReadDevice(deviceId);            
-            devices.push_back(device);
+            _devices.Erase(deviceName);
+            _flagWriter.Discard(deviceName);
         }
+        for (auto& it : dbDevices)
+            _devices.Insert(std::move(it.second));
+        LOG_INFO("Sync devices", "created", dbDevices.size(), "deleted", eraseDevices.size());
+    }
+
+    std::vector<Device> App::GetDevice(std::string deviceId)
+    {
+        Device device;
+        if (!_devices.Get(deviceId, device))
+            return {};
+
+        return { device };
+    }
 
-        return devices;
+    void App::LoadFlagRules()
+    {
+        const auto& path = _options.App.flag_rules;
+        std::shared_ptr<const FlagRules> flagRules = std::make_shared<FlagRules>(path.empty() ? FlagRules::Default() : FlagRules::FromFile(path));
+        LOG_INFO("Flag rules", "count", flagRules->Size(), "source", path.empty() ? "built-in" : path);
+        std::atomic_store(&_flagRules, std::move(flagRules));
     }
 
-    void App::OnMqttDevMessage(DevParam devParam)
+    void App::OnMqttDevMessages(const IngestQueue::Batch& batch)
     {
         using namespace std::chrono;
         auto timestampSeconds = duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
 
-        //std::cout << "OnMqttDevMessage:" << std::endl;
-        //std::cout << "\t devName: " << devParam.devName
-        //          << "\t param: " << devParam.paramId
-        //          << " value: " << devParam.paramValue << std::endl;
+        // Rules of the batch, a reload applies to the next one
+        auto flagRules = std::atomic_load(&_flagRules);
+        for (const DevMessage* message : batch)
+            OnMqttDevMessage(*message, *flagRules, timestampSeconds);
+    }
 
-        std::lock_guard<std::shared_timed_mutex> lock(_syncDevices);
+    void App::OnMqttDevMessage(const DevMessage& message, const FlagRules& flagRules, int64_t timestampSeconds)
+    {
+        ScopedTimer timer(_metrics.mqttMessageLatency);
+
+        // Params grouped by device: one lookup, shard lock and write-behind update per device of the message
+        thread_local std::vector<const DevMessage::Item*> items;
+        items.clear();
+        for (const auto& item : message)
+            items.push_back(&item);
+        std::stable_sort(items.begin(), items.end(), [&message](const DevMessage::Item* a, const DevMessage::Item* b)
+        {
+            return message.DevName(*a) < message.DevName(*b);
+        });
 
-        //std::cout << "Current devices: "<< std::endl;
-        //for (auto& dev : _devicesIds)
-        //{
-        //    std::cout << "\t " << dev << std::endl;
-        //}
+        for (auto it = items.begin(); it != items.end(); )
+        {
+            auto devName = message.DevName(**it);
+
+            // flags mapping, see FlagRules
+            std::bitset<FlagCount> changed;
+            size_t matched = 0;
+            for (; it != items.end() && message.DevName(**it) == devName; ++it)
+            {
+                //LOG_DEBUG("OnMqttDevMessage", "device", devName, "param", (*it)->paramId, "value", (*it)->paramValue);
+                size_t flagIndex = flagRules.Match((*it)->paramId, (*it)->paramValue);
+                if (flagIndex == NoFlag)
+                {
+                    ++_metrics.mqttItemsIgnored;
+                    continue;
+                }
+                changed.set(flagIndex);
+                ++matched;
+            }
+            if (matched == 0)
+                continue;
+
+            // Update flags, only the device's shard is locked
+            bool isUpdated = _devices.Update(devName, [&](Device& device)
+            {
+                for (size_t i = 0; i < FlagCount; ++i)
+                {
+                    if (!changed[i])
+                        continue;
+                    device.flags[i].value = true;
+                    device.flags[i].timestamp = timestampSeconds;
+                }
+
+                // Write behind to DB
+                _flagWriter.Update(device.name, device.flags, changed);
+            });
+
+            if (!isUpdated)
+            {
+                //LOG_DEBUG("OnMqttDevMessage: ignore", "device", devName);
+                _metrics.mqttItemsIgnored += matched;
+                continue; // Ignore other devices
+            }
 
-        auto it = _devicesIds.find(devParam.devName);
-        if (it == _devicesIds.end())
+            _metrics.mqttItemsApplied += matched;
+            LOG_DEBUG("OnMqttDevMessage: update", "device", fmt::string_view(devName.data(), devName.size()), "flags", changed.to_string());
+        }
+    }
+    
+    void App::HTTP_GET_Metrics(SharedSession session)
+    {
+        SessionReply(session, restbed::OK, _metrics.ToPrometheus(), {
+            {"Content-Type", "text/plain; version=0.0.4"}
+        });
+    }
+
+    bool App::SessionKeepAlive(const SharedSession& session)
+    {
+        // Requests served on the connection, session lives as long as the connection
+        size_t requests = session->has("requests") ? static_cast<size_t>(session->get("requests")) : 0;
+        session->set("requests", ++requests);
+
+        ++_metrics.httpRequests;
+        if (requests == 1)
+            ++_metrics.httpConnections;
+        else
+            ++_metrics.httpReusedRequests;
+
+        if (!_options.App.keep_alive)
+            return false;
+
+        // HTTP/1.1 is persistent by default, HTTP/1.0 on request only
+        const auto request = session->get_request();
+        std::string connection = request->get_header("Connection");
+        std::transform(connection.begin(), connection.end(), connection.begin(), ::tolower);
+        if (connection == "close")
+            return false;
+        if (request->get_version() < 1.1 && connection != "keep-alive")
+            return false;
+
+        // Pipelining: a body that wasn't read would be parsed as the next request
+        if (request->get_header<size_t>("Content-Length", 0) != request->get_body().size())
+            return false;
+
+        size_t maxRequests = _options.App.keep_alive_max_requests;
+        if (maxRequests != 0 && requests >= maxRequests)
         {
-            //std::cout << "OnMqttDevMessage: ignore devName: " << devParam.devName << std::endl;
-            return; // Ignore other devices
+            ++_metrics.httpClosedByLimit;
+            return false;
         }
+        return true;
+    }
 
-        // Update flags
-        auto device = _db.ReadDevice(devParam.devName);
-        bool isUpdated = false;
+    std::multimap<std::string, std::string> App::ConnectionHeaders(bool keepAlive) const
+    {
+        if (!keepAlive)
+            return { {"Connection", "close"} };
+
+        std::string params = fmt::format("timeout={}", _options.App.keep_alive_timeout);
+        if (_options.App.keep_alive_max_requests != 0)
+            params += fmt::format(", max={}", _options.App.keep_alive_max_requests);
+        return {
+            {"Connection", "keep-alive"},
+            {"Keep-Alive", params}
+        };
+    }
+
+    void App::SessionReply(const SharedSession& session, int statusCode, const std::string& body, std::multimap<std::string, std::string> headers)
+    {
+        bool keepAlive = SessionKeepAlive(session);
+        auto connectionHeaders = ConnectionHeaders(keepAlive);
+        headers.insert(connectionHeaders.begin(), connectionHeaders.end());
+        headers.emplace("Content-Length", std::to_string(body.size()));
+
+        // Yield without callback returns the connection to restbed to read the next request
+        if (keepAlive)
+            session->yield(statusCode, body, headers);
+        else
+            session->close(statusCode, body, headers);
+    }
+
+    void App::SessionReply_Encoded(const SharedSession& session, int statusCode, const json& data, Encoding encoding, int indent)
+    {
+        std::string body = Serialize(data, encoding, indent);
+        SessionReply(session, statusCode, body, {
+            {"Content-Type", GetContentType(encoding)}
+        });
+    }
+
+    bool App::SessionNotModified(const SharedSession& session, const std::string& etag)
+    {
+        const auto request = session->get_request();
+        if (!request->has_header("If-None-Match") || !MatchETag(request->get_header("If-None-Match"), etag))
+            return false;
 
-        // flags mapping:
-        if (devParam.paramId == 1 && devParam.paramValue == 0)
+        ++_metrics.httpNotModified;
+        SessionReply(session, restbed::NOT_MODIFIED, "", {
+            {"ETag", etag},
+            {"Vary", "Accept"}
+        });
+        return true;
+    }
+
+    void App::SessionStream_Chunks(const SharedSession& session, const std::shared_ptr<StreamedResponse>& response)
+    {
+        std::string chunk;
+        if (!response->stream->NextChunk(chunk))
         {
-            std::cout << "OnMqttDevMessage: update flag1" << std::endl;
-            device.flags["flag1"].value = true;
-            device.flags["flag1"].timestamp = timestampSeconds;
-            isUpdated = true;
+            if (response->cacheable)
+                _responseCache.Put(response->cacheKey, response->version, std::move(response->body));
+
+            // Last chunk
+            if (response->keepAlive)
+                session->yield("0\r\n\r\n");
+            else
+                session->close("0\r\n\r\n");
+            return;
         }
-        else if (devParam.paramId == 1 && devParam.paramValue == 1)
+
+        // Collect the body for the cache while it fits
+        if (response->cacheable && response->body.size() + chunk.size() <= _responseCache.MaxBytes())
         {
-            std::cout << "OnMqttDevMessage: update flag2" << std::endl;
-            device.flags["flag2"].value = true;
-            device.flags["flag2"].timestamp = timestampSeconds;
-            isUpdated = true;
+            response->body += chunk;
         }
-        else if (devParam.paramId == 2 && devParam.paramValue > 11)
+        else
         {
-            std::cout << "OnMqttDevMessage: update flag3" << std::endl;
-            device.flags["flag3"].value = true;
-            device.flags["flag3"].timestamp = timestampSeconds;
-            isUpdated = true;
+            response->cacheable = false;
+            std::string().swap(response->body);
         }
-        
-        if (isUpdated)
-            _db.UpdateDeviceFlags(std::move(device));
-    }
-    
-    void App::SessionClose_JSON(const SharedSession& session, int statusCode, const std::string& json)
-    {
-        session->close(statusCode, json, {
-            {"Content-Type",   "application/json"},
-            {"Content-Length", std::to_string(json.size())}
-        });
+
+        std::string frame = fmt::format("{:x}\r\n", chunk.size());
+        frame += chunk;
+        frame += "\r\n";
+        session->yield(frame, [this, response](const SharedSession s) { SessionStream_Chunks(s, response); });
     }
 
-    void App::SessionClose_TEXT(const SharedSession& session, int statusCode, const std::string& msg)
+    void App::SessionReply_TEXT(const SharedSession& session, int statusCode, const std::string& msg)
     {
-        session->close(statusCode, msg, {
-            {"Content-Type",   "text/plain"},
-            {"Content-Length", std::to_string(msg.size())}
+        SessionReply(session, statusCode, msg, {
+            {"Content-Type", "text/plain"}
         });
     }
 } // namespace app
\ No newline at end of file
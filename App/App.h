@@ -1,16 +1,29 @@
 ﻿#pragma once
 
+#include <functional>
+#include <map>
 #include <mutex>
-#include <shared_mutex>
 #include <set>
 
 #include "AppOptions.h"
+#include "AsyncDB.h"
 #include "Mqtt.h"
 #include "DB.h"
 #include "Device.h"
+#include "DeviceQuery.h"
+#include "DeviceRegistry.h"
+#include "DevicesListener.h"
+#include "DevicesStream.h"
+#include "Encoding.h"
+#include "FlagRules.h"
+#include "FlagWriter.h"
+#include "IngestQueue.h"
+#include "Metrics.h"
+#include "ResponseCache.h"
 
 namespace restbed
 {
+    class Request;
     class Service;
     class Session;
 }
@@ -28,29 +41,66 @@ namespace app
     private:
         void PublishResources();
         
-        void HTTP_GET_Devices(SharedSession session);
-        void HTTP_POST_Devices(SharedSession session);
-        void HTTP_DELETE_Devices(SharedSession session);
+        void HTTP_GET_Devices(SharedSession session, Encoding encoding);
+        void HTTP_POST_Devices(SharedSession session, Encoding encoding);
+        void HTTP_DELETE_Devices(SharedSession session, Encoding encoding);
+        void HTTP_GET_Metrics(SharedSession session);
+        std::function<void(SharedSession)> TimedHandler(HttpMethod method, std::function<void(SharedSession)> handler);
+
+        bool ReadReferenceTimestamp(const restbed::Request& request, uint64_t& timestamp, std::string& error);
+        bool ReadDeviceQuery(const restbed::Request& request, DeviceQuery& query, std::string& error);
+        bool ReadDevicesIds(const std::vector<uint8_t>& data, Encoding encoding, std::set<std::string>& devicesIds);
         
-        void SessionClose_JSON(const SharedSession& session, int statusCode, const std::string& json);
-        void SessionClose_TEXT(const SharedSession& session, int statusCode, const std::string& msg);
+        // Responses keep the connection open for the next request when keep-alive is allowed
+        bool SessionKeepAlive(const SharedSession& session);
+        std::multimap<std::string, std::string> ConnectionHeaders(bool keepAlive) const;
+        void SessionReply(const SharedSession& session, int statusCode, const std::string& body = "", std::multimap<std::string, std::string> headers = {});
+        void SessionReply_Encoded(const SharedSession& session, int statusCode, const json& data, Encoding encoding, int indent = -1);
+        void SessionReply_TEXT(const SharedSession& session, int statusCode, const std::string& msg);
+        bool SessionNotModified(const SharedSession& session, const std::string& etag); // Replies 304 on If-None-Match
+
+        // Chunked GET devices response, the body is collected for the response cache
+        struct StreamedResponse
+        {
+            std::shared_ptr<DevicesStream> stream;
+            bool        keepAlive = false;
+            std::string cacheKey;
+            uint64_t    version = 0;
+            bool        cacheable = true;
+            std::string body;
+        };
+        void SessionStream_Chunks(const SharedSession& session, const std::shared_ptr<StreamedResponse>& response);
 
-        void CreateDevices(std::set<std::string> devicesIds);
+        void LoadDevices();
+        size_t CreateDevices(std::set<std::string> devicesIds); // Returns count of created devices
         void DeleteDevices(std::set<std::string> devicesIds);
         void DeleteAllDevices();
+        void OnDevicesChange(const DevicesChange& change); // of another instance
+        void SyncDevices(); // Registry devices as in DB, the flags of known devices are kept
         std::vector<Device> GetDevice(std::string deviceId);
-        std::vector<Device> GetAllDevices();
 
-        void OnMqttDevMessage(DevParam devParam);
+        void LoadFlagRules();
+        void OnMqttDevMessages(const IngestQueue::Batch& batch);
+        void OnMqttDevMessage(const DevMessage& message, const FlagRules& flagRules, int64_t timestampSeconds);
         
     private:
         std::shared_ptr<restbed::Service> _service;
 
         AppOptions _options;
+        Metrics&   _metrics;
         Mqtt       _mqtt;
         DB         _db;
+        AsyncDB    _asyncDb; // flags flush, if enabled
+        DevicesListener _devicesListener;
+        FlagWriter _flagWriter;
+        IngestQueue _ingestQueue;
+
+        // Replaced atomically on reload, readers keep the rules they've loaded
+        std::shared_ptr<const FlagRules> _flagRules;
 
-        std::set<std::string>   _devicesIds;
-        std::shared_timed_mutex _syncDevices;
+        // In-memory devices state, persisted to DB
+        DeviceRegistry _devices;
+        ResponseCache  _responseCache;
+        std::mutex     _syncProvisioning; // serializes create/delete of devices
     };
 } // namespace app
\ No newline at end of file
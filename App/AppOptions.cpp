@@ -15,6 +15,20 @@ namespace app
             ("app_worker_count",               po::value<uint32_t>()->default_value(0), "REST worker count")
             ("app_change_timestamp_threshold", po::value<size_t>()->default_value(std::numeric_limits<size_t>::max()), 
                                                                                         "REST change_timestamp_threshold")
+            ("app_flag_rules", po::value<std::string>()->default_value(""), "Flag rules file (JSON), reloaded on SIGHUP")
+            ("app_keep_alive",              po::value<bool>()->default_value(true),    "REST persistent connections")
+            ("app_keep_alive_timeout",      po::value<size_t>()->default_value(5),     "REST idle connection timeout, s")
+            ("app_keep_alive_max_requests", po::value<size_t>()->default_value(1000),  "REST requests per connection, 0 - unlimited")
+            ("app_cache_time_bucket",       po::value<size_t>()->default_value(1),     "REST changeTimestamp time bucket of cached responses, s")
+            ("app_cache_max_bytes",         po::value<size_t>()->default_value(64 << 20), "REST response cache size, bytes, 0 - disabled")
+            ("app_device_filter_capacity",  po::value<size_t>()->default_value(100000), "Expected devices count, sizes the filter of unknown devices")
+            ("app_ingest_workers",          po::value<size_t>()->default_value(2),     "Ingest worker threads")
+            ("app_ingest_queue_size",       po::value<size_t>()->default_value(8192),  "Ingest queue size, MQTT messages")
+            ("app_ingest_batch_size",       po::value<size_t>()->default_value(256),   "Ingest batch size, params")
+            ("app_ingest_overflow",         po::value<std::string>()->default_value("block"), "Ingest queue overflow: block|drop_oldest|coalesce")
+            ("app_log_level",               po::value<std::string>()->default_value("info"), "Log level: debug|info|warning|error|off")
+            ("app_log_queue_size",          po::value<size_t>()->default_value(8192),  "Log queue size, records")
+            ("app_log_rate_limit",          po::value<size_t>()->default_value(100),   "Log records per second of a call site, 0 - unlimited")
             //               
             ("db_name",      po::value<std::string>()->required(),         "DataBase name")
             ("db_user",      po::value<std::string>()->required(),         "DataBase user")
@@ -23,11 +37,20 @@ namespace app
             ("db_port",      po::value<uint16_t>()->required(),            "DataBase port")
             ("db_timeout",   po::value<size_t>()->required(),              "DataBase timeout")
             ("db_pool_size", po::value<size_t>()->default_value(1),        "DataBase pool size")
+            ("db_flush_interval",   po::value<size_t>()->default_value(1000), "DataBase flags flush interval, ms")
+            ("db_flush_batch_size", po::value<size_t>()->default_value(1000), "DataBase flags flush batch size")
+            ("db_async_connections", po::value<size_t>()->default_value(0),   "DataBase pipelined connections for flags flush, 0 - disabled")
+            ("db_purge_orphan_flags", po::bool_switch(),                      "DataBase maintenance: delete flags of deleted devices and exit")
             //
             ("mqtt_host",    po::value<std::string>()->required(),         "MQTT host")
             ("mqtt_port",    po::value<uint16_t>()->required(),            "MQTT port")
             ("mqtt_timeout", po::value<size_t>()->required(),              "MQTT timeout")
             ("mqtt_topic",   po::value<std::string>()->default_value("#"), "MQTT topic")
+            ("mqtt_connections", po::value<size_t>()->default_value(1),       "MQTT consumer connections, more than 1 needs mqtt_share_group")
+            ("mqtt_share_group", po::value<std::string>()->default_value(""), "MQTT shared subscription group: $share/<group>/<topic>")
+            ("mqtt_qos",         po::value<int>()->default_value(1),          "MQTT subscription QoS")
+            ("mqtt_v5",          po::bool_switch(),                           "MQTT v5 protocol")
+            ("mqtt_topic_filter", po::bool_switch(),                          "MQTT first topic segment is the device id: drop messages of unknown devices unparsed")
             ;
 
         po::variables_map vm;
@@ -38,6 +61,20 @@ namespace app
         options.App.port                       = vm["app_port"].as<uint16_t>();
         options.App.worker_count               = vm["app_worker_count"].as<uint32_t>();
         options.App.change_timestamp_threshold = vm["app_change_timestamp_threshold"].as<size_t>();
+        options.App.flag_rules                 = vm["app_flag_rules"].as<std::string>();
+        options.App.keep_alive                 = vm["app_keep_alive"].as<bool>();
+        options.App.keep_alive_timeout         = vm["app_keep_alive_timeout"].as<size_t>();
+        options.App.keep_alive_max_requests    = vm["app_keep_alive_max_requests"].as<size_t>();
+        options.App.cache_time_bucket          = vm["app_cache_time_bucket"].as<size_t>();
+        options.App.cache_max_bytes            = vm["app_cache_max_bytes"].as<size_t>();
+        options.App.device_filter_capacity     = vm["app_device_filter_capacity"].as<size_t>();
+        options.App.ingest_workers             = vm["app_ingest_workers"].as<size_t>();
+        options.App.ingest_queue_size          = vm["app_ingest_queue_size"].as<size_t>();
+        options.App.ingest_batch_size          = vm["app_ingest_batch_size"].as<size_t>();
+        options.App.ingest_overflow            = vm["app_ingest_overflow"].as<std::string>();
+        options.App.log_level                  = vm["app_log_level"].as<std::string>();
+        options.App.log_queue_size             = vm["app_log_queue_size"].as<size_t>();
+        options.App.log_rate_limit             = vm["app_log_rate_limit"].as<size_t>();
 
         options.DB.dbname    = vm["db_name"].as<std::string>();
         options.DB.user      = vm["db_user"].as<std::string>();
@@ -46,11 +83,20 @@ namespace app
         options.DB.port      = vm["db_port"].as<uint16_t>();
         options.DB.timeout   = vm["db_timeout"].as<size_t>();
         options.DB.pool_size = vm["db_pool_size"].as<size_t>();
+        options.DB.flush_interval   = vm["db_flush_interval"].as<size_t>();
+        options.DB.flush_batch_size = vm["db_flush_batch_size"].as<size_t>();
+        options.DB.async_connections = vm["db_async_connections"].as<size_t>();
+        options.DB.purge_orphan_flags = vm["db_purge_orphan_flags"].as<bool>();
                              
         options.MQTT.host    = vm["mqtt_host"].as<std::string>();
         options.MQTT.port    = vm["mqtt_port"].as<uint16_t>();
         options.MQTT.timeout = vm["mqtt_timeout"].as<size_t>();
         options.MQTT.topic   = vm["mqtt_topic"].as<std::string>();
+        options.MQTT.connections = vm["mqtt_connections"].as<size_t>();
+        options.MQTT.share_group = vm["mqtt_share_group"].as<std::string>();
+        options.MQTT.qos         = vm["mqtt_qos"].as<int>();
+        options.MQTT.v5          = vm["mqtt_v5"].as<bool>();
+        options.MQTT.topic_filter = vm["mqtt_topic_filter"].as<bool>();
 
         return options;
     }
@@ -9,6 +9,26 @@ namespace app
         uint16_t port;
         uint32_t worker_count;
         size_t   change_timestamp_threshold;
+
+        std::string flag_rules; // Flag rules file, reloaded on SIGHUP. Built-in rules if empty
+
+        bool     keep_alive = true;             // HTTP persistent connections
+        size_t   keep_alive_timeout = 5;        // s, idle connection timeout
+        size_t   keep_alive_max_requests = 1000; // requests per connection, 0 - unlimited
+
+        size_t   cache_time_bucket = 1;          // s, changeTimestamp resolution of cacheable responses
+        size_t   cache_max_bytes = 64 << 20;     // GET devices response cache size, 0 - disabled
+
+        size_t   device_filter_capacity = 100000; // devices, sizes the filter of unknown devices
+
+        size_t   ingest_workers = 2;             // threads applying MQTT params to devices
+        size_t   ingest_queue_size = 8192;       // MQTT messages
+        size_t   ingest_batch_size = 256;        // params per worker wake-up, whole messages
+        std::string ingest_overflow = "block";   // block|drop_oldest|coalesce
+
+        std::string log_level = "info";          // debug|info|warning|error|off
+        size_t   log_queue_size = 8192;          // records, dropped when full
+        size_t   log_rate_limit = 100;           // records per second of a log call site, 0 - unlimited
     };
 
     struct DBConnectionParams
@@ -21,6 +41,13 @@ namespace app
         size_t      timeout;
 
         size_t      pool_size = 1;
+
+        size_t      flush_interval = 1000; // ms
+        size_t      flush_batch_size = 1000;
+
+        size_t      async_connections = 0; // pipelined connections for flags flush, 0 - flush on the pool
+
+        bool        purge_orphan_flags = false; // Maintenance: delete flags of missing devices and exit
     };
 
     struct MqttParams
@@ -29,6 +56,12 @@ namespace app
         uint16_t    port;
         size_t      timeout;
         std::string topic;
+
+        size_t      connections = 1;  // consumer connections, each with its own network thread
+        std::string share_group;      // subscribe to $share/<group>/<topic>, required for several connections
+        int         qos = 1;
+        bool        v5 = false;       // MQTT v5 protocol, v3.1.1 otherwise
+        bool        topic_filter = false; // first topic segment is the device id, messages of unknown devices are dropped unparsed
     };
 
     struct AppOptions
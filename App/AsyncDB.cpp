@@ -0,0 +1,375 @@
+﻿#include "AsyncDB.h"
+
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#define poll WSAPoll
+#else
+#include <poll.h>
+#endif
+
+#include <fmt/format.h>
+#include <libpq-fe.h>
+
+#include "Logger.h"
+#include "Metrics.h"
+
+namespace app
+{
+    namespace
+    {
+        // New requests are sent at least this often while results are awaited
+        constexpr int PollIntervalMs = 1;
+
+        struct PreparedStatement
+        {
+            const char* name;
+            std::string query;
+            int         paramCount;
+        };
+
+        // By AsyncDB::Statement, the same queries as the DB ones with positional parameters
+        const PreparedStatement PreparedStatements[] =
+        {
+            { "async_update_flags", MakeUpsertFlagsQuery("$1", "$2", "$3", "$4"), 4 },
+        };
+        static_assert(sizeof(PreparedStatements) / sizeof(PreparedStatements[0]) == 1, "Prepared statement for every AsyncDB::Statement");
+
+        DbMethod ToDbMethod(size_t statement)
+        {
+            static const DbMethod methods[] = { DbMethod::UpdateFlags };
+            return methods[statement];
+        }
+
+        std::string ErrorMessage(PGconn* conn)
+        {
+            std::string error = conn ? PQerrorMessage(conn) : "out of memory";
+            while (!error.empty() && (error.back() == '\n' || error.back() == '\r'))
+                error.pop_back();
+            return error;
+        }
+    } // namespace
+
+    // One pipelined connection and its event loop. Every request is followed by a sync point,
+    // so an error aborts only the statement of that request.
+    class AsyncDB::Connection
+    {
+    public:
+        Connection(std::string connectString, size_t index)
+            : _connectString(std::move(connectString))
+            , _index(index)
+        {
+        }
+
+        ~Connection()
+        {
+            Stop();
+        }
+
+        void Start()
+        {
+            std::string error;
+            if (!Open(error))
+                throw std::runtime_error(fmt::format("DB async connect: FAILED: {}", error));
+            _thread = std::thread(&Connection::Run, this);
+        }
+
+        void Stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_sync);
+                _stop = true;
+            }
+            _wakeUp.notify_one();
+
+            if (_thread.joinable())
+                _thread.join();
+
+            if (_conn)
+            {
+                PQfinish(_conn);
+                _conn = nullptr;
+            }
+        }
+
+        void Submit(Request&& request)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_sync);
+                _queued.push_back(std::move(request));
+            }
+            _wakeUp.notify_one();
+        }
+
+    private:
+        void Run()
+        {
+            std::deque<Request> requests;
+            for (;;)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_sync);
+                    if (_inFlight.empty())
+                        _wakeUp.wait(lock, [this] { return _stop || !_queued.empty(); });
+                    if (_stop && _queued.empty() && _inFlight.empty())
+                        return;
+                    requests.swap(_queued);
+                }
+
+                if (!requests.empty())
+                {
+                    // Reconnect after a connection error
+                    std::string error;
+                    if (!_conn && !Open(error))
+                    {
+                        LOG_ERROR("DB async connect: FAILED", "connection", _index, "error", error);
+                        for (auto& request : requests)
+                            Complete(request, error);
+                    }
+                    else
+                    {
+                        for (auto& request : requests)
+                            Send(request);
+                    }
+                    requests.clear();
+                }
+
+                if (!_inFlight.empty() && !Poll())
+                    Close(ErrorMessage(_conn));
+            }
+        }
+
+        bool Open(std::string& error)
+        {
+            _conn = PQconnectdb(_connectString.c_str());
+            if (!_conn || PQstatus(_conn) != CONNECTION_OK)
+            {
+                error = ErrorMessage(_conn);
+                Close(error);
+                return false;
+            }
+
+            for (const auto& statement : PreparedStatements)
+            {
+                PGresult* result = PQprepare(_conn, statement.name, statement.query.c_str(), statement.paramCount, nullptr);
+                bool isPrepared = PQresultStatus(result) == PGRES_COMMAND_OK;
+                if (!isPrepared)
+                    error = PQresultErrorMessage(result);
+                PQclear(result);
+                if (!isPrepared)
+                {
+                    Close(error);
+                    return false;
+                }
+            }
+
+            if (PQsetnonblocking(_conn, 1) != 0 || PQenterPipelineMode(_conn) != 1)
+            {
+                error = ErrorMessage(_conn);
+                Close(error);
+                return false;
+            }
+            return true;
+        }
+
+        // Fails in-flight requests, the next requests reconnect
+        void Close(const std::string& error)
+        {
+            for (auto& request : _inFlight)
+                Complete(request, error);
+            Metrics::Instance().dbAsyncInFlight -= _inFlight.size();
+            _inFlight.clear();
+            _error.clear();
+
+            if (_conn)
+            {
+                PQfinish(_conn);
+                _conn = nullptr;
+            }
+        }
+
+        void Send(Request& request)
+        {
+            const PreparedStatement& statement = PreparedStatements[static_cast<size_t>(request.statement)];
+
+            std::vector<const char*> values;
+            for (const auto& param : request.params)
+                values.push_back(param.c_str());
+
+            if (!PQsendQueryPrepared(_conn, statement.name, static_cast<int>(values.size()), values.data(), nullptr, nullptr, 0) ||
+                !PQpipelineSync(_conn))
+            {
+                Complete(request, ErrorMessage(_conn));
+                return;
+            }
+
+            ++Metrics::Instance().dbAsyncInFlight;
+            _inFlight.push_back(std::move(request));
+        }
+
+        // Sends buffered requests and reads available results, false on connection error
+        bool Poll()
+        {
+            int flush = PQflush(_conn);
+            if (flush < 0)
+                return false;
+
+            int fd = PQsocket(_conn);
+            if (fd < 0)
+                return false;
+
+            // poll, not select: the socket can be above FD_SETSIZE with many HTTP and MQTT connections open
+            pollfd pfd{};
+            pfd.fd     = fd;
+            pfd.events = POLLIN;
+            if (flush == 1)
+                pfd.events |= POLLOUT;
+
+            // No wait while results are already buffered: PQflush reads input when the socket is full
+            int ready = poll(&pfd, 1, PQisBusy(_conn) ? PollIntervalMs : 0);
+            if (ready < 0 && errno != EINTR)
+                return false;
+
+            // Whatever poll says: input read by PQflush doesn't make the socket readable again
+            if (!PQconsumeInput(_conn))
+                return false;
+
+            while (!_inFlight.empty() && !PQisBusy(_conn))
+            {
+                PGresult* result = PQgetResult(_conn);
+                if (!result)
+                    continue; // End of the statement results, its sync follows
+
+                switch (PQresultStatus(result))
+                {
+                case PGRES_PIPELINE_SYNC:
+                    Complete(_inFlight.front(), _error);
+                    _inFlight.pop_front();
+                    --Metrics::Instance().dbAsyncInFlight;
+                    _error.clear();
+                    break;
+
+                case PGRES_COMMAND_OK:
+                case PGRES_TUPLES_OK:
+                    break;
+
+                case PGRES_PIPELINE_ABORTED:
+                    if (_error.empty())
+                        _error = "pipeline aborted";
+                    break;
+
+                default:
+                    if (_error.empty())
+                        _error = PQresultErrorMessage(result);
+                    break;
+                }
+                PQclear(result);
+            }
+            return true;
+        }
+
+        static void Complete(Request& request, const std::string& error)
+        {
+            Metrics& metrics = Metrics::Instance();
+            auto method = static_cast<size_t>(ToDbMethod(static_cast<size_t>(request.statement)));
+            metrics.dbLatency[method].Record(std::chrono::steady_clock::now() - request.start);
+            if (!error.empty())
+                ++metrics.dbErrors[method];
+
+            request.completion(error);
+        }
+
+    private:
+        std::string _connectString;
+        size_t      _index;
+        PGconn*     _conn = nullptr;
+
+        std::mutex              _sync;
+        std::condition_variable _wakeUp;
+        std::deque<Request>     _queued;
+        bool                    _stop = false;
+        std::thread             _thread;
+
+        // Event loop thread only
+        std::deque<Request>     _inFlight; // in send order, results come in the same order
+        std::string             _error;    // of the front in-flight request
+    };
+
+    AsyncDB::AsyncDB() = default;
+
+    AsyncDB::~AsyncDB()
+    {
+        Stop();
+    }
+
+    void AsyncDB::Connect(const DBConnectionParams& p)
+    {
+        for (size_t i = 0; i < p.async_connections; ++i)
+        {
+            std::unique_ptr<Connection> connection(new Connection(MakeConnectString(p), i));
+            connection->Start();
+            _connections.push_back(std::move(connection));
+        }
+
+        if (!_connections.empty())
+            LOG_INFO("DB async connect: OK", "connections", _connections.size());
+    }
+
+    void AsyncDB::Stop()
+    {
+        for (auto& connection : _connections)
+            connection->Stop();
+        _connections.clear();
+    }
+
+    void AsyncDB::UpdateFlags(const std::vector<FlagUpdate>& updates, Completion completion)
+    {
+        std::vector<std::string> deviceNames;
+        std::vector<std::string> flagNames;
+        std::vector<int>         values;
+        std::vector<long long>   timestamps;
+        for (const auto& update : updates)
+        {
+            deviceNames.push_back(update.deviceName);
+            flagNames.push_back(update.flagName);
+            values.push_back(update.value ? 1 : 0);
+            timestamps.push_back(static_cast<long long>(update.timestamp));
+        }
+
+        Request request;
+        request.statement  = Statement::UpdateFlags;
+        request.params     = { ToPgArray(deviceNames), ToPgArray(flagNames), ToPgArray(values), ToPgArray(timestamps) };
+        request.completion = std::move(completion);
+        Submit(std::move(request));
+    }
+
+    std::future<void> AsyncDB::UpdateFlags(const std::vector<FlagUpdate>& updates)
+    {
+        auto promise = std::make_shared<std::promise<void>>();
+        auto future = promise->get_future();
+        UpdateFlags(updates, [promise](const std::string& error)
+        {
+            if (error.empty())
+                promise->set_value();
+            else
+                promise->set_exception(std::make_exception_ptr(std::runtime_error(error)));
+        });
+        return future;
+    }
+
+    void AsyncDB::Submit(Request&& request)
+    {
+        if (_connections.empty())
+            throw std::logic_error("DB async: not connected");
+
+        request.start = std::chrono::steady_clock::now();
+        size_t index = _next.fetch_add(1, std::memory_order_relaxed) % _connections.size();
+        _connections[index]->Submit(std::move(request));
+    }
+} // namespace app
\ No newline at end of file
@@ -0,0 +1,54 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AppOptions.h"
+#include "DB.h"
+
+namespace app
+{
+    // Asynchronous DB executor: a few connections in libpq pipeline mode, each driven by its own
+    // event loop thread. Statements are sent without waiting for results of the previous ones,
+    // so many of them are in flight on a connection and throughput isn't bound by the round trip.
+    class AsyncDB
+    {
+    public:
+        // Called once on the connection thread, error is empty on success
+        using Completion = std::function<void(const std::string& error)>;
+
+        AsyncDB();
+        ~AsyncDB();
+
+        void Connect(const DBConnectionParams& p); // No connections if p.async_connections is 0
+        void Stop(); // Completes queued statements
+        bool IsConnected() const { return !_connections.empty(); }
+
+        void UpdateFlags(const std::vector<FlagUpdate>& updates, Completion completion);
+        std::future<void> UpdateFlags(const std::vector<FlagUpdate>& updates); // Throws std::runtime_error on error
+
+    private:
+        enum class Statement { UpdateFlags, Count };
+
+        struct Request
+        {
+            Statement                             statement;
+            std::vector<std::string>              params;
+            Completion                            completion;
+            std::chrono::steady_clock::time_point start;
+        };
+
+        class Connection;
+
+        void Submit(Request&& request);
+
+    private:
+        std::vector<std::unique_ptr<Connection>> _connections;
+        std::atomic<size_t>                      _next{ 0 }; // round robin
+    };
+} // namespace app
\ No newline at end of file
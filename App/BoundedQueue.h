@@ -0,0 +1,118 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace app
+{
+    // Lock-free bounded MPMC queue (D. Vyukov): a ring of cells with sequence numbers,
+    // producers and consumers only CAS their own position. Push fails when the queue is full.
+    template<typename T>
+    class BoundedQueue
+    {
+    public:
+        explicit BoundedQueue(size_t capacity)
+            : _capacity(RoundUp(capacity))
+            , _mask(_capacity - 1)
+            , _cells(new Cell[_capacity])
+        {
+            for (size_t i = 0; i < _capacity; ++i)
+                _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        // The value is moved only on success
+        bool TryPush(T&& value)
+        {
+            Cell* cell;
+            size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                cell = &_cells[pos & _mask];
+                size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+                if (diff == 0)
+                {
+                    if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                    return false; // full
+                else
+                    pos = _enqueuePos.load(std::memory_order_relaxed);
+            }
+
+            cell->value = std::move(value);
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool TryPop(T& value)
+        {
+            Cell* cell;
+            size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                cell = &_cells[pos & _mask];
+                size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+                if (diff == 0)
+                {
+                    if (_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                    return false; // empty
+                else
+                    pos = _dequeuePos.load(std::memory_order_relaxed);
+            }
+
+            value = std::move(cell->value);
+            cell->sequence.store(pos + _mask + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Approximate, exact only without concurrent push/pop
+        size_t Size() const
+        {
+            size_t enqueuePos = _enqueuePos.load(std::memory_order_relaxed);
+            size_t dequeuePos = _dequeuePos.load(std::memory_order_relaxed);
+            return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+        }
+
+        size_t Capacity() const { return _capacity; }
+
+    private:
+        static size_t RoundUp(size_t capacity)
+        {
+            size_t result = 2;
+            while (result < capacity)
+                result <<= 1;
+            return result;
+        }
+
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T                   value;
+        };
+
+        static constexpr size_t CacheLine = 64;
+
+        const size_t            _capacity;
+        const size_t            _mask;
+        std::unique_ptr<Cell[]> _cells;
+
+        // Producers and consumers positions on separate cache lines
+        char                    _pad0[CacheLine];
+        std::atomic<size_t>     _enqueuePos{ 0 };
+        char                    _pad1[CacheLine - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t>     _dequeuePos{ 0 };
+        char                    _pad2[CacheLine - sizeof(std::atomic<size_t>)];
+    };
+} // namespace app
\ No newline at end of file
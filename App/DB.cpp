@@ -1,12 +1,20 @@
 ﻿#include "DB.h"
 
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iterator>
+#include <random>
+#include <stdexcept>
 
 #include <fmt/format.h>
 
 #include <soci/soci.h>
 #include <soci/postgresql/soci-postgresql.h>
 
+#include "Logger.h"
+#include "Metrics.h"
+
 namespace app
 {
     struct DB_Device
@@ -79,12 +87,9 @@ namespace app
 {
     using namespace soci;
 
-    DB::DB() = default;
-    DB::~DB() = default;
-
-    void DB::Connect(const DBConnectionParams& p)
+    std::string MakeConnectString(const DBConnectionParams& p)
     {
-        std::string connectString = fmt::format(
+        return fmt::format(
             "dbname={} user={} password={} host={} port={} connect_timeout={} application_name='app'",
             p.dbname,
             p.user,
@@ -92,6 +97,281 @@ namespace app
             p.host,
             p.port,
             p.timeout);
+    }
+
+    std::string MakeUpsertFlagsQuery(const char* deviceNames, const char* flagNames, const char* flagValues, const char* flagTimestamps)
+    {
+        // All updates in one statement: arrays are unnested into rows
+        return fmt::format(
+            "INSERT INTO flags(device_id, flag_name, flag_value, flag_timestamp) "
+            "SELECT d.device_id, v.flag_name, v.flag_value, v.flag_timestamp "
+            "FROM unnest(CAST({} AS text[]), "
+            "            CAST({} AS text[]), "
+            "            CAST({} AS boolean[]), "
+            "            CAST({} AS bigint[])) "
+            "     AS v(device_name, flag_name, flag_value, flag_timestamp) "
+            "JOIN devices d ON d.device_name = v.device_name "
+            "ON CONFLICT(device_id, flag_name) "
+            "    DO UPDATE SET flag_value     = EXCLUDED.flag_value, "
+            "                  flag_timestamp = EXCLUDED.flag_timestamp "
+            "    WHERE flags.flag_timestamp <= EXCLUDED.flag_timestamp",
+            deviceNames,
+            flagNames,
+            flagValues,
+            flagTimestamps);
+    }
+
+    std::string ToPgArray(const std::vector<std::string>& values)
+    {
+        std::string result = "{";
+        for (const auto& value : values)
+        {
+            if (result.size() > 1)
+                result += ',';
+            result += '"';
+            for (char c : value)
+            {
+                if (c == '"' || c == '\\')
+                    result += '\\';
+                result += c;
+            }
+            result += '"';
+        }
+        result += '}';
+        return result;
+    }
+
+    namespace
+    {
+        constexpr size_t MaxNotifyPayload = 7999; // Postgres limit is 8000 bytes
+
+        const char* DevicesChangeOps[] = { "create", "delete", "delete_all", "sync" };
+    } // namespace
+
+    const char* ToString(DevicesChange::Op op)
+    {
+        return DevicesChangeOps[static_cast<size_t>(op)];
+    }
+
+    std::string ToPayload(const DevicesChange& change)
+    {
+        json j = {
+            {"instance", change.instance},
+            {"op", ToString(change.op)}
+        };
+        if (change.op == DevicesChange::Op::Create || change.op == DevicesChange::Op::Delete)
+            j["devices"] = change.deviceNames;
+
+        std::string payload = j.dump();
+        if (payload.size() <= MaxNotifyPayload)
+            return payload;
+
+        // Too many names: receivers compare all devices with DB
+        return json{ {"instance", change.instance}, {"op", ToString(DevicesChange::Op::Sync)} }.dump();
+    }
+
+    DevicesChange ParseDevicesChange(const std::string& payload)
+    {
+        json j = json::parse(payload);
+
+        DevicesChange change;
+        change.instance = j.at("instance").get<std::string>();
+        auto op = j.at("op").get<std::string>();
+        auto it = std::find(std::begin(DevicesChangeOps), std::end(DevicesChangeOps), op);
+        if (it == std::end(DevicesChangeOps))
+            throw std::invalid_argument(fmt::format("Unknown devices change: \"{}\"", op));
+        change.op = static_cast<DevicesChange::Op>(it - std::begin(DevicesChangeOps));
+        if (j.count("devices"))
+            change.deviceNames = j["devices"].get<std::vector<std::string>>();
+        return change;
+    }
+
+    namespace
+    {
+        // Metrics of a DB call: pool wait until Leased(), latency and errors until the call returns or throws
+        class DbCall
+        {
+        public:
+            explicit DbCall(DbMethod method)
+                : _method(static_cast<size_t>(method))
+                , _start(std::chrono::steady_clock::now())
+            {
+            }
+
+            ~DbCall()
+            {
+                Metrics& metrics = Metrics::Instance();
+                metrics.dbLatency[_method].Record(std::chrono::steady_clock::now() - _start);
+                if (std::uncaught_exception())
+                    ++metrics.dbErrors[_method];
+            }
+
+            void Leased()
+            {
+                Metrics::Instance().dbPoolWait.Record(std::chrono::steady_clock::now() - _start);
+            }
+
+        private:
+            size_t                                _method;
+            std::chrono::steady_clock::time_point _start;
+        };
+
+        // Pooled connection for the call, its position selects the prepared statements
+        class Lease
+        {
+        public:
+            explicit Lease(connection_pool& pool)
+                : _pool(pool)
+                , _position(pool.lease())
+            {
+            }
+            ~Lease() { _pool.give_back(_position); }
+
+            Lease(const Lease&) = delete;
+            Lease& operator=(const Lease&) = delete;
+
+            size_t   Position() const { return _position; }
+            session& Session()  const { return _pool.at(_position); }
+
+        private:
+            connection_pool& _pool;
+            size_t           _position;
+        };
+
+        // One query for devices and their flags, rows of a device are adjacent
+        const char* SelectDevicesQuery =
+            "SELECT d.device_name, f.flag_name, CAST(f.flag_value AS integer), f.flag_timestamp "
+            "FROM devices d "
+            "LEFT JOIN flags f ON f.device_id = d.device_id ";
+
+        struct Migration
+        {
+            int                      version;
+            std::string              description;
+            std::vector<std::string> statements;
+        };
+
+        // Schema versions, applied in order at DB::Connect. Never edit an applied migration, add a new one.
+        const std::vector<Migration>& GetMigrations()
+        {
+            static const std::vector<Migration> migrations =
+            {
+                {
+                    1, "Devices and flags tables",
+                    {
+                        "CREATE TABLE IF NOT EXISTS devices "
+                        "( "
+                        "    device_id bigint PRIMARY KEY NOT NULL GENERATED ALWAYS AS IDENTITY ( INCREMENT 1 START 1 MINVALUE 1 MAXVALUE 9223372036854775807 CACHE 1 ), "
+                        "    device_name text COLLATE pg_catalog.\"default\" NOT NULL, "
+                        "    CONSTRAINT name_unique UNIQUE (device_name) "
+                        ")",
+                        "CREATE TABLE IF NOT EXISTS flags "
+                        "( "
+                        "    flag_id bigint NOT NULL GENERATED ALWAYS AS IDENTITY ( INCREMENT 1 START 1 MINVALUE 1 MAXVALUE 9223372036854775807 CACHE 1 ), "
+                        "    device_id bigint NOT NULL, "
+                        "    flag_name text COLLATE pg_catalog.\"default\" NOT NULL, "
+                        "    flag_value boolean NOT NULL, "
+                        "    flag_timestamp BIGINT NOT NULL "
+                        ")",
+                    }
+                },
+                {
+                    2, "Flags: unique (device_id, flag_name), cascade delete with device",
+                    {
+                        // Orphans and duplicates would break the new constraints
+                        "DELETE FROM flags "
+                        "WHERE NOT EXISTS (SELECT 1 FROM devices WHERE devices.device_id = flags.device_id)",
+                        "DELETE FROM flags f "
+                        "USING flags newer "
+                        "WHERE newer.device_id = f.device_id "
+                        "  AND newer.flag_name = f.flag_name "
+                        "  AND newer.flag_id > f.flag_id",
+                        "ALTER TABLE flags ADD CONSTRAINT flags_pkey PRIMARY KEY (flag_id)",
+                        "ALTER TABLE flags ADD CONSTRAINT flags_device_flag_unique UNIQUE (device_id, flag_name)",
+                        "ALTER TABLE flags ADD CONSTRAINT flags_device_fk FOREIGN KEY (device_id) "
+                        "    REFERENCES devices (device_id) ON DELETE CASCADE",
+                    }
+                },
+            };
+            return migrations;
+        }
+    }
+
+    // Server-side prepared statements with bound parameters: callers set the parameters and execute.
+    // Postgres parses and plans them once per connection.
+    struct DB::Statements
+    {
+        // Parameters: Postgres array literals
+        std::string deviceNames;
+        std::string flagNames;
+        std::string flagValues;
+        std::string flagTimestamps;
+
+        // Row of selectDevices
+        std::string deviceName;
+        std::string flagName;
+        int         flagValue = 0;
+        long long   flagTimestamp = 0;
+        indicator   flagNameInd = i_ok;
+        indicator   flagValueInd = i_ok;
+        indicator   flagTimestampInd = i_ok;
+
+        statement insertDevices;
+        statement insertDefaultFlags;
+        statement selectDevices;
+        statement upsertFlags;
+        statement deleteDevices;
+
+        explicit Statements(session& sql)
+            : insertDevices((sql.prepare <<
+                "INSERT INTO devices(device_name) "
+                "SELECT unnest(CAST(:device_names AS text[])) "
+                "ON CONFLICT(device_name) DO NOTHING",
+                use(deviceNames, "device_names")))
+            // Default flags for every device, existing flags are kept
+            , insertDefaultFlags((sql.prepare <<
+                "INSERT INTO flags(device_id, flag_name, flag_value, flag_timestamp) "
+                "SELECT d.device_id, f.flag_name, f.flag_value, f.flag_timestamp "
+                "FROM devices d "
+                "CROSS JOIN unnest(CAST(:flag_names AS text[]), "
+                "                  CAST(:flag_values AS boolean[]), "
+                "                  CAST(:flag_timestamps AS bigint[])) "
+                "     AS f(flag_name, flag_value, flag_timestamp) "
+                "WHERE d.device_name = ANY(CAST(:device_names AS text[])) "
+                "ON CONFLICT(device_id, flag_name) DO NOTHING",
+                use(flagNames,      "flag_names"),
+                use(flagValues,     "flag_values"),
+                use(flagTimestamps, "flag_timestamps"),
+                use(deviceNames,    "device_names")))
+            , selectDevices((sql.prepare <<
+                std::string(SelectDevicesQuery) +
+                "WHERE d.device_name = ANY(CAST(:device_names AS text[])) "
+                "ORDER BY d.device_name",
+                use(deviceNames, "device_names"),
+                into(deviceName),
+                into(flagName,      flagNameInd),
+                into(flagValue,     flagValueInd),
+                into(flagTimestamp, flagTimestampInd)))
+            , upsertFlags((sql.prepare <<
+                MakeUpsertFlagsQuery(":device_names", ":flag_names", ":flag_values", ":flag_timestamps"),
+                use(deviceNames,    "device_names"),
+                use(flagNames,      "flag_names"),
+                use(flagValues,     "flag_values"),
+                use(flagTimestamps, "flag_timestamps")))
+            // Flags are deleted by cascade
+            , deleteDevices((sql.prepare <<
+                "DELETE FROM devices WHERE device_name = ANY(CAST(:device_names AS text[]))",
+                use(deviceNames, "device_names")))
+        {
+        }
+    };
+
+    DB::DB() = default;
+    DB::~DB() = default;
+
+    void DB::Connect(const DBConnectionParams& p)
+    {
+        std::string connectString = MakeConnectString(p);
 
         size_t poolSize = std::max<size_t>(p.pool_size, 1);
         _pool = std::make_unique<connection_pool>(poolSize);
@@ -103,152 +383,276 @@ namespace app
             if (!sql.is_connected())
                 throw std::runtime_error("DB connect: FAILED");
         }
-        std::cout << "DB connect: OK" << std::endl;
+        LOG_INFO("DB connect: OK");
+
+        std::random_device random;
+        _instance = fmt::format("{:08x}{:08x}", random(), random());
+
+        Migrate();
+
+        // After migrations: statements refer to the current schema
+        _statements.clear();
+        for (size_t i = 0; i != poolSize; ++i)
+            _statements.push_back(std::make_unique<Statements>(_pool->at(i)));
     }
 
-    void DB::CreateDevice(Device device)
+    void DB::Migrate()
     {
         session sql(*_pool);
+        transaction tr(sql);
+
+        // Serialize migrations of concurrently starting instances
+        sql << "SELECT pg_advisory_xact_lock(hashtext('app_schema_migrations'))";
 
-        try
+        sql << "CREATE TABLE IF NOT EXISTS schema_migrations "
+               "( "
+               "    version integer PRIMARY KEY NOT NULL, "
+               "    description text NOT NULL, "
+               "    applied_at timestamptz NOT NULL DEFAULT now() "
+               ")";
+
+        int currentVersion = 0;
+        indicator ind = i_null;
+        sql << "SELECT MAX(version) FROM schema_migrations", into(currentVersion, ind);
+        if (ind == i_null)
+            currentVersion = 0;
+
+        for (const auto& migration : GetMigrations())
         {
-            transaction tr(sql);
+            if (migration.version <= currentVersion)
+                continue;
 
-            long long deviceId;
-            sql << "INSERT INTO devices(device_name) "
-                   "            values(:device_name) "
-                   "ON CONFLICT(device_name) "
-                   "    DO UPDATE SET device_name = EXCLUDED.device_name "
-                   "RETURNING device_id",
-                use(device.name), into(deviceId);
+            for (const auto& statement : migration.statements)
+                sql << statement;
 
-            for (const auto& it : device.flags)
-            {
-                auto& flagName = it.first;
-                auto& flag = it.second;
-
-                DB_Flag dbFlag;
-                dbFlag.device_id      = deviceId;
-                dbFlag.flag_name      = flagName;
-                dbFlag.flag_value     = flag.value;
-                dbFlag.flag_timestamp = flag.timestamp;
-                sql << "INSERT INTO flags(device_id,  flag_name,  flag_value,  flag_timestamp) "
-                       "SELECT           :device_id, :flag_name, :flag_value, :flag_timestamp "
-                       "WHERE NOT EXISTS ( "
-                       "	SELECT * FROM flags "
-                       "		WHERE device_id = :device_id "
-                       "		  AND flag_name = :flag_name "
-                       ")",
-                        use(dbFlag);
-            }
+            sql << "INSERT INTO schema_migrations(version, description) values(:version, :description)",
+                use(migration.version), use(migration.description);
+            currentVersion = migration.version;
 
-            tr.commit();
+            LOG_INFO("DB migration", "version", migration.version, "description", migration.description);
         }
-        catch (std::exception& ex)
+
+        tr.commit();
+        LOG_INFO("DB schema version", "version", currentVersion);
+    }
+
+    size_t DB::CreateDevices(const std::vector<std::string>& deviceNames)
+    {
+        if (deviceNames.empty())
+            return 0;
+
+        std::vector<std::string> flagNames;
+        std::vector<int>         flagValues;
+        std::vector<long long>   flagTimestamps;
+        const auto defaultFlags = Device::GetDefaultFlags();
+        for (size_t i = 0; i < FlagCount; ++i)
         {
-            std::cout << ex.what() << std::endl;
+            flagNames.push_back(FlagTable[i].name);
+            flagValues.push_back(defaultFlags[i].value ? 1 : 0);
+            flagTimestamps.push_back(static_cast<long long>(defaultFlags[i].timestamp));
         }
+
+        std::string pgDeviceNames    = ToPgArray(deviceNames);
+        std::string pgFlagNames      = ToPgArray(flagNames);
+        std::string pgFlagValues     = ToPgArray(flagValues);
+        std::string pgFlagTimestamps = ToPgArray(flagTimestamps);
+
+        DbCall call(DbMethod::CreateDevices);
+        Lease lease(*_pool);
+        call.Leased();
+        Statements& st = *_statements[lease.Position()];
+        transaction tr(lease.Session());
+
+        st.deviceNames = std::move(pgDeviceNames);
+        st.insertDevices.execute(true);
+        auto created = static_cast<size_t>(st.insertDevices.get_affected_rows());
+
+        st.flagNames      = std::move(pgFlagNames);
+        st.flagValues     = std::move(pgFlagValues);
+        st.flagTimestamps = std::move(pgFlagTimestamps);
+        st.insertDefaultFlags.execute(true);
+
+        Notify(lease.Session(), DevicesChange::Op::Create, deviceNames);
+        tr.commit();
+        return created;
     }
 
-    Device DB::ReadDevice(std::string deviceName)
+    std::vector<Device> DB::ReadDevices()
     {
-        session sql(*_pool);
-        
-        Device device;
+        return SelectDevices(nullptr);
+    }
 
-        try
-        {
-            transaction tr(sql);
+    std::vector<Device> DB::ReadDevices(const std::vector<std::string>& deviceNames)
+    {
+        if (deviceNames.empty())
+            return {};
+        return SelectDevices(&deviceNames);
+    }
 
-            DB_Device dev;
-            sql << "SELECT * FROM devices WHERE device_name = :name", use(deviceName), into(dev);
-            device.name = dev.device_name;
+    std::vector<Device> DB::SelectDevices(const std::vector<std::string>* deviceNames)
+    {
+        DbCall call(DbMethod::ReadDevices);
+        Lease lease(*_pool);
+        call.Leased();
 
-            rowset<DB_Flag> rs = (sql.prepare << "SELECT * FROM flags WHERE device_id = :devId", use(dev.device_id));
-            for (auto dbFlag = rs.begin(); dbFlag != rs.end(); ++dbFlag)
+        std::vector<Device> devices;
+        auto addRow = [&devices](std::string& deviceName, const std::string* flagName, int flagValue, long long flagTimestamp)
+        {
+            if (devices.empty() || devices.back().name != deviceName)
             {
-                auto& flag = device.flags[dbFlag->flag_name];
-                flag.value     = dbFlag->flag_value;
-                flag.timestamp = dbFlag->flag_timestamp;
+                devices.emplace_back();
+                devices.back().name = std::move(deviceName);
             }
 
-            tr.commit();
+            if (!flagName)
+                return; // Device without flags
+
+            auto index = FindFlag(*flagName);
+            if (index == NoFlag)
+                return; // Flag isn't in the flags table
+
+            auto& flag = devices.back().flags[index];
+            flag.value     = flagValue != 0;
+            flag.timestamp = flagTimestamp;
+        };
+
+        if (deviceNames)
+        {
+            // Prepared: lookups of a few devices
+            Statements& st = *_statements[lease.Position()];
+            st.deviceNames = ToPgArray(*deviceNames);
+            st.selectDevices.execute();
+            while (st.selectDevices.fetch())
+            {
+                bool hasFlag = st.flagNameInd != i_null;
+                addRow(st.deviceName, hasFlag ? &st.flagName : nullptr, st.flagValue, st.flagTimestamp);
+            }
         }
-        catch(std::exception& ex)
+        else
         {
-            std::cout << ex.what() << std::endl;
-            return {};
+            // One-shot: all devices at startup
+            session& sql = lease.Session();
+            rowset<row> rs = (sql.prepare << std::string(SelectDevicesQuery) + "ORDER BY d.device_name");
+            for (auto it = rs.begin(); it != rs.end(); ++it)
+            {
+                const row& r = *it;
+                auto deviceName = r.get<std::string>(0);
+                bool hasFlag = r.get_indicator(1) != i_null;
+                std::string flagName = hasFlag ? r.get<std::string>(1) : std::string();
+                addRow(deviceName, hasFlag ? &flagName : nullptr, hasFlag ? r.get<int>(2) : 0, hasFlag ? r.get<long long>(3) : 0);
+            }
         }
-        return device;
+        return devices;
     }
     
-    std::set<std::string> DB::ReadDevicesNames() const
+    void DB::UpdateFlags(const std::vector<FlagUpdate>& updates)
     {
-        session sql(*_pool);
-        rowset<std::string> rs = (sql.prepare << "SELECT device_name FROM devices");
-        std::set<std::string> names;
-        std::copy(rs.begin(), rs.end(), std::inserter(names, names.end()));
-        return names;
+        if (updates.empty())
+            return;
+
+        std::vector<std::string> deviceNames;
+        std::vector<std::string> flagNames;
+        std::vector<int>         values;
+        std::vector<long long>   timestamps;
+        deviceNames.reserve(updates.size());
+        flagNames.reserve(updates.size());
+        values.reserve(updates.size());
+        timestamps.reserve(updates.size());
+        for (const auto& update : updates)
+        {
+            deviceNames.push_back(update.deviceName);
+            flagNames.push_back(update.flagName);
+            values.push_back(update.value ? 1 : 0);
+            timestamps.push_back(static_cast<long long>(update.timestamp));
+        }
+
+        std::string pgDeviceNames = ToPgArray(deviceNames);
+        std::string pgFlagNames   = ToPgArray(flagNames);
+        std::string pgValues      = ToPgArray(values);
+        std::string pgTimestamps  = ToPgArray(timestamps);
+
+        DbCall call(DbMethod::UpdateFlags);
+        Lease lease(*_pool);
+        call.Leased();
+
+        Statements& st = *_statements[lease.Position()];
+        st.deviceNames    = std::move(pgDeviceNames);
+        st.flagNames      = std::move(pgFlagNames);
+        st.flagValues     = std::move(pgValues);
+        st.flagTimestamps = std::move(pgTimestamps);
+        st.upsertFlags.execute(true);
     }
 
-    void DB::UpdateDeviceFlags(Device device)
+    void DB::DeleteDevices(const std::vector<std::string>& deviceNames)
     {
+        if (deviceNames.empty())
+            return;
+
+        std::string pgDeviceNames = ToPgArray(deviceNames);
+
+        DbCall call(DbMethod::DeleteDevices);
+        Lease lease(*_pool);
+        call.Leased();
+        transaction tr(lease.Session());
+
+        Statements& st = *_statements[lease.Position()];
+        st.deviceNames = std::move(pgDeviceNames);
+        st.deleteDevices.execute(true);
+
+        Notify(lease.Session(), DevicesChange::Op::Delete, deviceNames);
+        tr.commit();
+    }
+
+    void DB::DeleteAllDevices()
+    {
+        DbCall call(DbMethod::DeleteAllDevices);
         session sql(*_pool);
+        call.Leased();
+        transaction tr(sql);
 
-        try
-        {
-            transaction tr(sql);
-            
-            DB_Device dbDev;
-            sql << "SELECT * FROM devices WHERE device_name = :name", use(device.name), into(dbDev);
+        sql << "TRUNCATE flags, devices";
 
-            for (const auto& it : device.flags)
-            {
-                auto& flagName = it.first;
-                auto& flag = it.second;
-
-                DB_Flag dbFlag;
-                dbFlag.device_id = dbDev.device_id;
-                dbFlag.flag_name = flagName;
-                dbFlag.flag_value = flag.value;
-                dbFlag.flag_timestamp = flag.timestamp;
-                
-                sql << "UPDATE flags "
-                       "SET flag_value     = :flag_value, "
-                       "    flag_timestamp = :flag_timestamp "
-                       "WHERE device_id = :device_id "
-                       "  AND flag_name = :flag_name;",
-                    use(dbFlag);
-            }
+        Notify(sql, DevicesChange::Op::DeleteAll, {});
+        tr.commit();
+    }
 
-            tr.commit();
-        }
-        catch (std::exception& ex)
-        {
-            std::cout << ex.what() << std::endl;
-        }
+    void DB::Notify(session& sql, DevicesChange::Op op, const std::vector<std::string>& deviceNames) const
+    {
+        // Delivered to listeners on commit, dropped on rollback
+        DevicesChange change{ _instance, op, deviceNames };
+        std::string channel = DevicesChannel;
+        std::string payload = ToPayload(change);
+        sql << "SELECT pg_notify(:channel, :payload)", use(channel), use(payload);
     }
 
-    void DB::DeleteDevice(const std::string& deviceName) const
-    {      
+    size_t DB::PurgeOrphanFlags() const
+    {
+        DbCall call(DbMethod::PurgeOrphanFlags);
         session sql(*_pool);
-        sql << "DELETE FROM devices WHERE device_name = :name;", use(deviceName);
+        call.Leased();
+        statement purge = (sql.prepare <<
+            "DELETE FROM flags "
+            "WHERE NOT EXISTS ( "
+            "	SELECT 1 FROM devices "
+            "		WHERE devices.device_id = flags.device_id "
+            ")");
+        purge.execute(true);
+        return static_cast<size_t>(purge.get_affected_rows());
     }
 
     void DB::TestSelectMultipleRows()
     {
         session sql(*_pool);
 
-        rowset<DB_Flag> rs = (sql.prepare << "SELECT * FROM flags");
+        rowset<DB_Flag> rs = (sql.prepare << "SELECT flag_id, device_id, flag_name, CAST(flag_value AS integer) AS flag_value, flag_timestamp FROM flags");
         for (auto flag = rs.begin(); flag != rs.end(); ++flag)
         {
-            auto str = fmt::format("flag_id: {}, device_id: {}, flag_name: {}, flag_value: {}, flag_timestamp: {}",
-                flag->flag_id,
-                flag->device_id,
-                flag->flag_name,
-                flag->flag_value,
-                flag->flag_timestamp);
-            std::cout << str << std::endl;
+            LOG_DEBUG("DB flag",
+                "flag_id",        flag->flag_id,
+                "device_id",      flag->device_id,
+                "flag_name",      flag->flag_name,
+                "flag_value",     flag->flag_value,
+                "flag_timestamp", flag->flag_timestamp);
         }
     }
 } // namespace app
\ No newline at end of file
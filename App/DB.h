@@ -1,6 +1,7 @@
 ﻿#pragma once
 
-#include <set>
+#include <string>
+#include <vector>
 
 #include <soci/session.h>
 
@@ -9,6 +10,54 @@
 
 namespace app
 {
+    struct FlagUpdate
+    {
+        std::string deviceName;
+        std::string flagName;
+        bool        value;
+        uint64_t    timestamp;
+    };
+
+    // Provisioning change of devices, announced by DB to other App instances on commit:
+    //      NOTIFY app_devices, '{"instance":"...","op":"create","devices":["dev0",...]}'
+    struct DevicesChange
+    {
+        enum class Op { Create, Delete, DeleteAll, Sync }; // Sync: compare all devices with DB
+
+        std::string              instance; // DB::InstanceId() of the sender
+        Op                       op = Op::Sync;
+        std::vector<std::string> deviceNames; // of Create and Delete
+    };
+
+    constexpr const char* DevicesChannel = "app_devices";
+
+    const char* ToString(DevicesChange::Op op);
+    std::string ToPayload(const DevicesChange& change); // Over the NOTIFY payload limit the change becomes Sync
+    DevicesChange ParseDevicesChange(const std::string& payload); // throws on malformed payload
+
+    std::string MakeConnectString(const DBConnectionParams& p);
+
+    // Upsert of flags from the parallel arrays bound to the given placeholders, ":name" of soci or "$n" of libpq.
+    // Instances sharing MQTT flush the same flags: an older flush doesn't overwrite a newer one
+    std::string MakeUpsertFlagsQuery(const char* deviceNames, const char* flagNames, const char* flagValues, const char* flagTimestamps);
+
+    // Postgres array literal for binding a list as a single parameter: {"a","b"}
+    std::string ToPgArray(const std::vector<std::string>& values);
+
+    template<typename T>
+    std::string ToPgArray(const std::vector<T>& values)
+    {
+        std::string result = "{";
+        for (const auto& value : values)
+        {
+            if (result.size() > 1)
+                result += ',';
+            result += std::to_string(value);
+        }
+        result += '}';
+        return result;
+    }
+
     class DB
     {
     public:
@@ -16,16 +65,29 @@ namespace app
         ~DB();
 
         void Connect(const DBConnectionParams& p);
+        const std::string& InstanceId() const { return _instance; } // Random per process, tags sent devices changes
 
-        void CreateDevice(Device device);
-        Device ReadDevice(std::string deviceName);
-        std::set<std::string> ReadDevicesNames() const;
-        void UpdateDeviceFlags(Device device);
-        void DeleteDevice(const std::string& deviceName) const;
+        size_t CreateDevices(const std::vector<std::string>& deviceNames); // Returns count of created devices
+        // Not const: rebind the prepared statements of the leased connection
+        std::vector<Device> ReadDevices();
+        std::vector<Device> ReadDevices(const std::vector<std::string>& deviceNames);
+        void UpdateFlags(const std::vector<FlagUpdate>& updates);
+        void DeleteDevices(const std::vector<std::string>& deviceNames);
+        void DeleteAllDevices();
+        size_t PurgeOrphanFlags() const; // Returns count of deleted flags
 
 
         void TestSelectMultipleRows();
     private:
-        std::unique_ptr<soci::connection_pool> _pool;
+        void Migrate();
+        void Notify(soci::session& sql, DevicesChange::Op op, const std::vector<std::string>& deviceNames) const; // in the caller's transaction
+        std::vector<Device> SelectDevices(const std::vector<std::string>* deviceNames);
+
+        // Hot queries, prepared once per pooled connection at Connect
+        struct Statements;
+
+        std::unique_ptr<soci::connection_pool>   _pool;
+        std::vector<std::unique_ptr<Statements>> _statements; // by pool position
+        std::string                              _instance;
     };
 } // namespace app
\ No newline at end of file
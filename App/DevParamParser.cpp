@@ -0,0 +1,389 @@
+﻿#include "DevParamParser.h"
+
+#include <climits>
+#include <cstring>
+
+namespace app
+{
+    DevParamParser::DevParamParser(const char* data, size_t size)
+        : _begin(data)
+        , _pos(data)
+        , _end(data + size)
+    {
+        // Payload may be NUL-terminated by the publisher
+        while (_end != _begin && _end[-1] == '\0')
+            --_end;
+    }
+
+    bool DevParamParser::Next(Item& item)
+    {
+        while (!_finished)
+        {
+            SkipWhitespace();
+            if (!_started)
+            {
+                // Top level: array of objects or a single object
+                _started = true;
+                if (_pos == _end)
+                {
+                    _finished = true;
+                    return false;
+                }
+                if (*_pos == '[')
+                {
+                    _inArray = true;
+                    ++_pos;
+                    SkipWhitespace();
+                    if (_pos != _end && *_pos == ']')
+                    {
+                        ++_pos;
+                        _finished = true;
+                        return false;
+                    }
+                }
+            }
+            else if (_inArray)
+            {
+                if (_pos == _end)
+                    return Fail();
+                if (*_pos == ']')
+                {
+                    ++_pos;
+                    _finished = true;
+                    return false;
+                }
+                if (*_pos != ',')
+                    return Fail();
+                ++_pos;
+                SkipWhitespace();
+            }
+            else
+            {
+                _finished = true;
+                return false;
+            }
+
+            bool isValid = true;
+            if (!ParseObject(item, isValid))
+                return Fail();
+            if (isValid)
+                return true;
+        }
+        return false;
+    }
+
+    bool DevParamParser::ParseObject(Item& item, bool& isValid)
+    {
+        if (_pos == _end || *_pos != '{')
+            return false;
+        ++_pos;
+
+        bool hasDevEui = false;
+        bool hasParamId = false;
+        bool hasValue = false;
+
+        SkipWhitespace();
+        if (_pos != _end && *_pos == '}')
+        {
+            ++_pos;
+            isValid = false;
+            return true;
+        }
+
+        for (;;)
+        {
+            const char* key;
+            size_t keySize;
+            bool keyEscaped;
+            if (!ParseString(key, keySize, keyEscaped))
+                return false;
+
+            SkipWhitespace();
+            if (_pos == _end || *_pos != ':')
+                return false;
+            ++_pos;
+            SkipWhitespace();
+
+            switch (keyEscaped ? Field::Unknown : ToField(key, keySize))
+            {
+            case Field::DevEui:
+                if (_pos != _end && *_pos == '"')
+                {
+                    bool nameEscaped;
+                    if (!ParseString(item.devName, item.devNameSize, nameEscaped))
+                        return false;
+                    hasDevEui = true;
+                    if (nameEscaped)
+                    {
+                        hasDevEui = Unescape(item.devName, item.devNameSize);
+                        item.devName = _unescaped.data();
+                        item.devNameSize = _unescaped.size();
+                    }
+                }
+                else if (!SkipValue())
+                    return false;
+                break;
+            case Field::ParamId:
+                if (!ParseInt(item.paramId, hasParamId))
+                    return false;
+                break;
+            case Field::Value:
+                if (!ParseInt(item.paramValue, hasValue))
+                    return false;
+                break;
+            case Field::Unknown:
+                if (!SkipValue())
+                    return false;
+                break;
+            }
+
+            SkipWhitespace();
+            if (_pos == _end)
+                return false;
+            if (*_pos == '}')
+            {
+                ++_pos;
+                break;
+            }
+            if (*_pos != ',')
+                return false;
+            ++_pos;
+            SkipWhitespace();
+        }
+
+        isValid = hasDevEui && hasParamId && hasValue;
+        return true;
+    }
+
+    bool DevParamParser::ParseString(const char*& str, size_t& size, bool& hasEscapes)
+    {
+        if (_pos == _end || *_pos != '"')
+            return false;
+        ++_pos;
+
+        hasEscapes = false;
+        const char* begin = _pos;
+        for (;;)
+        {
+            auto quote = static_cast<const char*>(std::memchr(_pos, '"', _end - _pos));
+            if (!quote)
+                return false;
+
+            // Quote is escaped if preceded by an odd number of backslashes
+            size_t backslashes = 0;
+            for (const char* p = quote; p != begin && p[-1] == '\\'; --p)
+                ++backslashes;
+
+            if (!hasEscapes)
+                hasEscapes = std::memchr(_pos, '\\', quote - _pos) != nullptr;
+
+            _pos = quote + 1;
+            if (backslashes % 2 == 0)
+            {
+                str = begin;
+                size = static_cast<size_t>(quote - begin);
+                return true;
+            }
+        }
+    }
+
+    bool DevParamParser::ParseInt(int& value, bool& isValid)
+    {
+        const char* start = _pos;
+        bool negative = false;
+        if (_pos != _end && *_pos == '-')
+        {
+            negative = true;
+            ++_pos;
+        }
+
+        const char* digits = _pos;
+        long long result = 0;
+        isValid = true;
+        while (_pos != _end && *_pos >= '0' && *_pos <= '9')
+        {
+            if (result <= static_cast<long long>(INT_MAX) + 1)
+                result = result * 10 + (*_pos - '0');
+            ++_pos;
+        }
+
+        if (_pos == digits)
+        {
+            // Not a number: skip the value and ignore the object
+            _pos = start;
+            isValid = false;
+            return SkipValue();
+        }
+
+        // Fraction and exponent are dropped, as std::stoi did: 12.7 -> 12, 1e3 -> 1
+        while (_pos != _end && ((*_pos >= '0' && *_pos <= '9') ||
+               *_pos == '.' || *_pos == 'e' || *_pos == 'E' || *_pos == '+' || *_pos == '-'))
+            ++_pos;
+
+        if (negative)
+            result = -result;
+        if (result > INT_MAX || result < INT_MIN)
+            isValid = false;
+        value = static_cast<int>(result);
+        return true;
+    }
+
+    bool DevParamParser::Unescape(const char* str, size_t size)
+    {
+        _unescaped.clear();
+        const char* end = str + size;
+        while (str != end)
+        {
+            char c = *str++;
+            if (c != '\\')
+            {
+                _unescaped += c;
+                continue;
+            }
+            if (str == end)
+                return false;
+            switch (*str++)
+            {
+            case '"':  _unescaped += '"';  break;
+            case '\\': _unescaped += '\\'; break;
+            case '/':  _unescaped += '/';  break;
+            case 'b':  _unescaped += '\b'; break;
+            case 'f':  _unescaped += '\f'; break;
+            case 'n':  _unescaped += '\n'; break;
+            case 'r':  _unescaped += '\r'; break;
+            case 't':  _unescaped += '\t'; break;
+            case 'u':
+            {
+                auto readHex = [&](unsigned& code) {
+                    if (end - str < 4)
+                        return false;
+                    code = 0;
+                    for (int i = 0; i < 4; ++i, ++str)
+                    {
+                        char h = *str;
+                        code <<= 4;
+                        if (h >= '0' && h <= '9')      code |= h - '0';
+                        else if (h >= 'a' && h <= 'f') code |= h - 'a' + 10;
+                        else if (h >= 'A' && h <= 'F') code |= h - 'A' + 10;
+                        else return false;
+                    }
+                    return true;
+                };
+
+                unsigned code;
+                if (!readHex(code))
+                    return false;
+                if (code >= 0xD800 && code <= 0xDBFF)
+                {
+                    // Surrogate pair
+                    unsigned low;
+                    if (end - str < 2 || str[0] != '\\' || str[1] != 'u')
+                        return false;
+                    str += 2;
+                    if (!readHex(low) || low < 0xDC00 || low > 0xDFFF)
+                        return false;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                else if (code >= 0xDC00 && code <= 0xDFFF)
+                    return false;
+
+                // UTF-8
+                if (code < 0x80)
+                    _unescaped += static_cast<char>(code);
+                else if (code < 0x800)
+                {
+                    _unescaped += static_cast<char>(0xC0 | (code >> 6));
+                    _unescaped += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else if (code < 0x10000)
+                {
+                    _unescaped += static_cast<char>(0xE0 | (code >> 12));
+                    _unescaped += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    _unescaped += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else
+                {
+                    _unescaped += static_cast<char>(0xF0 | (code >> 18));
+                    _unescaped += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                    _unescaped += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    _unescaped += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool DevParamParser::SkipValue()
+    {
+        if (_pos == _end)
+            return false;
+
+        if (*_pos == '"')
+        {
+            const char* str;
+            size_t size;
+            bool hasEscapes;
+            return ParseString(str, size, hasEscapes);
+        }
+
+        if (*_pos == '{' || *_pos == '[')
+        {
+            // Nested object/array: track depth, strings may contain brackets
+            size_t depth = 0;
+            while (_pos != _end)
+            {
+                char c = *_pos;
+                if (c == '"')
+                {
+                    const char* str;
+                    size_t size;
+                    bool hasEscapes;
+                    if (!ParseString(str, size, hasEscapes))
+                        return false;
+                    continue;
+                }
+                ++_pos;
+                if (c == '{' || c == '[')
+                    ++depth;
+                else if ((c == '}' || c == ']') && --depth == 0)
+                    return true;
+            }
+            return false;
+        }
+
+        // Number or literal
+        const char* start = _pos;
+        while (_pos != _end && *_pos != ',' && *_pos != '}' && *_pos != ']' &&
+               *_pos != ' ' && *_pos != '\t' && *_pos != '\r' && *_pos != '\n')
+            ++_pos;
+        return _pos != start;
+    }
+
+    void DevParamParser::SkipWhitespace()
+    {
+        while (_pos != _end && (*_pos == ' ' || *_pos == '\t' || *_pos == '\r' || *_pos == '\n'))
+            ++_pos;
+    }
+
+    bool DevParamParser::Fail()
+    {
+        _error = true;
+        _finished = true;
+        return false;
+    }
+
+    DevParamParser::Field DevParamParser::ToField(const char* key, size_t size)
+    {
+        switch (size)
+        {
+        case 5:  return std::memcmp(key, "value", 5) == 0    ? Field::Value   : Field::Unknown;
+        case 7:  return std::memcmp(key, "dev_eui", 7) == 0  ? Field::DevEui  : Field::Unknown;
+        case 8:  return std::memcmp(key, "param_id", 8) == 0 ? Field::ParamId : Field::Unknown;
+        default: return Field::Unknown;
+        }
+    }
+} // namespace app
\ No newline at end of file
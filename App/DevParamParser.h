@@ -0,0 +1,57 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace app
+{
+    // Streaming parser of MQTT device payload:
+    //      [{"dev_eui":"dev0","param_id":1,"value":0}, ...]
+    // Works in place over the payload buffer without copies. Keys may come in any order,
+    // unknown keys are skipped, objects without valid dev_eui/param_id/value are ignored.
+    // Numbers keep the std::stoi semantics of the former regex parser: only the leading
+    // integer part is used, so 12.7 reads as 12. Escaped names are unescaped into a parser
+    // buffer, the only case that copies.
+    class DevParamParser
+    {
+    public:
+        struct Item
+        {
+            const char* devName;     // points into payload (or the unescape buffer), not NUL-terminated, valid until the next Next()
+            size_t      devNameSize;
+            int         paramId;
+            int         paramValue;
+        };
+
+        DevParamParser(const char* data, size_t size);
+
+        // Returns false at the end of payload or on syntax error
+        bool Next(Item& item);
+
+        bool   HasError()    const { return _error; }
+        size_t ErrorOffset() const { return static_cast<size_t>(_pos - _begin); }
+
+    private:
+        enum class Field { Unknown, DevEui, ParamId, Value };
+
+        bool ParseObject(Item& item, bool& isValid);
+        bool ParseString(const char*& str, size_t& size, bool& hasEscapes);
+        bool ParseInt(int& value, bool& isValid);
+        bool Unescape(const char* str, size_t size);
+        bool SkipValue();
+        void SkipWhitespace();
+        bool Fail();
+
+        static Field ToField(const char* key, size_t size);
+
+    private:
+        const char* _begin;
+        const char* _pos;
+        const char* _end;
+        std::string _unescaped;
+        bool        _inArray = false;
+        bool        _started = false;
+        bool        _finished = false;
+        bool        _error = false;
+    };
+} // namespace app
\ No newline at end of file
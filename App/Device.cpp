@@ -2,22 +2,39 @@
 
 namespace app
 {
+    size_t FindFlag(const std::string& flagName)
+    {
+        for (size_t i = 0; i < FlagCount; ++i)
+        {
+            if (flagName == FlagTable[i].name)
+                return i;
+        }
+        return NoFlag;
+    }
+
     Device::Flags Device::GetDefaultFlags()
     {
-        Flags flags;
-        flags["flag1"] = {};
-        flags["flag2"] = {};
-        flags["flag3"] = {};
+        Flags flags{};
+        for (size_t i = 0; i < FlagCount; ++i)
+            flags[i].value = FlagTable[i].defaultValue;
         return flags;
     }
 
-    void Device::CalcDynamicFlags(size_t threshold)
+    void Device::CalcChangeTimestamps(uint64_t timestamp)
     {
-        acceptanceResult = std::all_of(flags.begin(), flags.end(), [threshold](const auto& f)
+        for (auto& flag : flags)
         {
-            const Flag& flag = f.second;
-            return flag.value && flag.changeTimestamp < threshold;
-        });
+            if (flag.value == true)
+                flag.changeTimestamp = timestamp > flag.timestamp ? timestamp - flag.timestamp : 0;
+        }
+    }
+
+    void Device::CalcDynamicFlags(size_t threshold)
+    {
+        bool result = true;
+        for (const auto& flag : flags)
+            result &= flag.value & (flag.changeTimestamp < threshold);
+        acceptanceResult = result;
     }
 
     void to_json(json& j, const Device& device)
@@ -26,12 +43,11 @@ namespace app
             {"id",               device.name},
             {"acceptanceResult", device.acceptanceResult},
         };
-        for (auto& it : device.flags)
+        for (size_t i = 0; i < FlagCount; ++i)
         {
-            auto& flagName = it.first;
-            auto& flag = it.second;
+            const auto& flag = device.flags[i];
             json jsonFlag = json{
-                {"name",            flagName},
+                {"name",            FlagTable[i].name},
                 {"value",           flag.value},
                 {"changeTimestamp", flag.changeTimestamp}
             };
@@ -47,8 +63,11 @@ namespace app
         auto& flags = j.at("flags");
         for (auto& jsonFlag : flags)
         {
-            auto flagName = jsonFlag["name"].get<std::string>();
-            auto& flag = device.flags[flagName];
+            auto index = FindFlag(jsonFlag["name"].get<std::string>());
+            if (index == NoFlag)
+                continue;
+
+            auto& flag = device.flags[index];
             jsonFlag.at("value").get_to(flag.value);
             jsonFlag.at("changeTimestamp").get_to(flag.changeTimestamp);
         }
@@ -1,6 +1,8 @@
 ﻿#pragma once
 
-#include <unordered_map>
+#include <array>
+#include <climits>
+#include <cstdint>
 #include <string>
 
 #include <nlohmann/json.hpp>
@@ -9,6 +11,28 @@ using json = nlohmann::json;
 
 namespace app
 {
+    // Flags table: the order defines flag index in Device::flags
+    struct FlagDef
+    {
+        const char* name;
+        bool        defaultValue;
+        // Default rule of MQTT param setting the flag, see FlagRules
+        int         paramId;
+        int         paramValueMin; // inclusive
+        int         paramValueMax; // inclusive
+    };
+
+    constexpr FlagDef FlagTable[] = {
+        { "flag1", false, 1, 0,  0       },
+        { "flag2", false, 1, 1,  1       },
+        { "flag3", false, 2, 12, INT_MAX },
+    };
+    constexpr size_t FlagCount = sizeof(FlagTable) / sizeof(FlagTable[0]);
+    constexpr size_t NoFlag = FlagCount;
+
+    // Index of flag by name, NoFlag if unknown
+    size_t FindFlag(const std::string& flagName);
+
     struct Device
     {
         struct Flag
@@ -17,13 +41,15 @@ namespace app
             uint64_t    timestamp = 0;
             uint64_t    changeTimestamp = 0;
         };
-        using Flags = std::unordered_map<std::string, Flag>;
+        using Flags = std::array<Flag, FlagCount>;
 
         std::string name;
         bool        acceptanceResult = false;
         Flags       flags = GetDefaultFlags();
+        uint64_t    version = 0; // DeviceRegistry version of the last change
 
         static Flags GetDefaultFlags();
+        void CalcChangeTimestamps(uint64_t timestamp);
         void CalcDynamicFlags(size_t threshold);
     };
 
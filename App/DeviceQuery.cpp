@@ -0,0 +1,68 @@
+﻿#include "DeviceQuery.h"
+
+namespace app
+{
+    constexpr size_t DeviceCursor::PageSize;
+
+    bool DeviceQuery::Match(const Device& device) const
+    {
+        if (hasAcceptanceResult && device.acceptanceResult != acceptanceResult)
+            return false;
+
+        for (const auto& it : flags)
+        {
+            if (device.flags[it.first].value != it.second)
+                return false;
+        }
+        return true;
+    }
+
+    DeviceCursor::DeviceCursor(const DeviceRegistry& devices, DeviceQuery query, uint64_t timestamp, size_t threshold)
+        : _devices(devices)
+        , _query(std::move(query))
+        , _timestamp(timestamp)
+        , _threshold(threshold)
+    {
+        if (_query.hasAfter)
+            _lastName = _query.after;
+    }
+
+    bool DeviceCursor::Next(Device& device)
+    {
+        while (!_finished && _count < _query.limit)
+        {
+            if (_pagePos == _page.size())
+            {
+                bool hasAfter = _query.hasAfter || !_page.empty();
+                _page = _devices.GetPage(hasAfter ? &_lastName : nullptr, _query.prefix, PageSize);
+                _pagePos = 0;
+                if (_page.empty())
+                {
+                    _finished = true;
+                    break;
+                }
+                _lastName = _page.back().name;
+            }
+
+            Device& candidate = _page[_pagePos++];
+            candidate.CalcChangeTimestamps(_timestamp);
+            candidate.CalcDynamicFlags(_threshold);
+            if (!_query.Match(candidate))
+                continue;
+
+            ++_count;
+            _lastReturnedName = candidate.name;
+            device = std::move(candidate);
+            return true;
+        }
+        return false;
+    }
+
+    const std::string* DeviceCursor::GetNextAfter() const
+    {
+        // Limit reached: next page starts after the last returned device
+        if (_finished || _count == 0 || _count < _query.limit)
+            return nullptr;
+        return &_lastReturnedName;
+    }
+} // namespace app
\ No newline at end of file
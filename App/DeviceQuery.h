@@ -0,0 +1,57 @@
+﻿#pragma once
+
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Device.h"
+#include "DeviceRegistry.h"
+
+namespace app
+{
+    // Filters and keyset pagination of GET /devices
+    struct DeviceQuery
+    {
+        bool        hasAfter = false;
+        std::string after;       // cursor: devices with names greater than after
+        std::string prefix;      // device name prefix
+        size_t      limit = std::numeric_limits<size_t>::max();
+
+        bool        hasAcceptanceResult = false;
+        bool        acceptanceResult = false;
+        std::vector<std::pair<size_t, bool>> flags; // flag index, value
+
+        // Device must have dynamic flags calculated
+        bool Match(const Device& device) const;
+    };
+
+    // Iterates devices of registry matching the query in name order, page by page.
+    // Returned devices have changeTimestamp and dynamic flags calculated.
+    class DeviceCursor
+    {
+    public:
+        static constexpr size_t PageSize = 256;
+
+        DeviceCursor(const DeviceRegistry& devices, DeviceQuery query, uint64_t timestamp, size_t threshold);
+
+        // Returns false at the end or when limit is reached
+        bool Next(Device& device);
+
+        // Cursor for the next page, null if there are no more devices
+        const std::string* GetNextAfter() const;
+
+    private:
+        const DeviceRegistry& _devices;
+        DeviceQuery           _query;
+        uint64_t              _timestamp;
+        size_t                _threshold;
+
+        std::vector<Device> _page;
+        size_t              _pagePos = 0;
+        size_t              _count = 0;
+        bool                _finished = false;
+        std::string         _lastName;         // last device of page
+        std::string         _lastReturnedName;
+    };
+} // namespace app
\ No newline at end of file
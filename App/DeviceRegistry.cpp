@@ -0,0 +1,155 @@
+﻿#include "DeviceRegistry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+namespace app
+{
+    DeviceRegistry::DeviceRegistry(size_t shardCount, size_t filterCapacity)
+        : _filter(filterCapacity)
+    {
+        using namespace std::chrono;
+        _version = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+
+        _shards.resize(std::max<size_t>(shardCount, 1));
+        for (auto& shard : _shards)
+            shard = std::make_unique<Shard>();
+    }
+
+    void DeviceRegistry::Reset(std::vector<Device> devices)
+    {
+        for (auto& shard : _shards)
+        {
+            std::lock_guard<std::shared_timed_mutex> lock(shard->sync);
+            shard->devices.clear();
+        }
+        _filter.Clear();
+        ++_version;
+
+        for (auto& device : devices)
+            Insert(std::move(device));
+    }
+
+    bool DeviceRegistry::Insert(Device device)
+    {
+        Shard& shard = GetShard(device.name);
+        std::lock_guard<std::shared_timed_mutex> lock(shard.sync);
+
+        auto deviceName = device.name;
+        device.version = ++_version;
+        auto result = shard.devices.emplace(std::move(deviceName), std::move(device));
+        if (result.second)
+            _filter.Add(result.first->first);
+        return result.second;
+    }
+
+    bool DeviceRegistry::Erase(const std::string& deviceName)
+    {
+        Shard& shard = GetShard(deviceName);
+        std::lock_guard<std::shared_timed_mutex> lock(shard.sync);
+
+        if (shard.devices.erase(deviceName) == 0)
+            return false;
+        _filter.Remove(deviceName);
+
+        ++_version;
+        return true;
+    }
+
+    bool DeviceRegistry::Contains(const std::string& deviceName) const
+    {
+        const Shard& shard = GetShard(deviceName);
+        std::shared_lock<std::shared_timed_mutex> lock(shard.sync);
+
+        return shard.devices.count(deviceName) != 0;
+    }
+
+    bool DeviceRegistry::Get(const std::string& deviceName, Device& device) const
+    {
+        const Shard& shard = GetShard(deviceName);
+        std::shared_lock<std::shared_timed_mutex> lock(shard.sync);
+
+        auto it = shard.devices.find(deviceName);
+        if (it == shard.devices.end())
+            return false;
+
+        device = it->second;
+        return true;
+    }
+
+    std::vector<Device> DeviceRegistry::GetPage(const std::string* after, const std::string& prefix, size_t limit) const
+    {
+        using Iterator = Devices::const_iterator;
+        using Range    = std::pair<Iterator, Iterator>;
+
+        // Shared locks of all shards are taken in the same order, writers lock a single shard
+        std::vector<std::shared_lock<std::shared_timed_mutex>> locks;
+        locks.reserve(_shards.size());
+
+        std::vector<Range> ranges;
+        ranges.reserve(_shards.size());
+        for (auto& shard : _shards)
+        {
+            locks.emplace_back(shard->sync);
+            auto begin = after ? shard->devices.upper_bound(*after) : shard->devices.begin();
+            if (begin != shard->devices.end() && begin->first < prefix)
+                begin = shard->devices.lower_bound(prefix);
+            if (begin != shard->devices.end())
+                ranges.emplace_back(begin, shard->devices.end());
+        }
+
+        // k-way merge of sorted shards
+        auto greater = [](const Range& a, const Range& b) { return a.first->first > b.first->first; };
+        std::make_heap(ranges.begin(), ranges.end(), greater);
+
+        std::vector<Device> devices;
+        while (!ranges.empty() && devices.size() < limit)
+        {
+            std::pop_heap(ranges.begin(), ranges.end(), greater);
+            auto& range = ranges.back();
+            if (range.first->first.compare(0, prefix.size(), prefix) != 0)
+                break; // Names are sorted, no more names with prefix
+            devices.push_back(range.first->second);
+            if (++range.first == range.second)
+                ranges.pop_back();
+            else
+                std::push_heap(ranges.begin(), ranges.end(), greater);
+        }
+        return devices;
+    }
+
+    size_t DeviceRegistry::Size() const
+    {
+        size_t size = 0;
+        for (auto& shard : _shards)
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(shard->sync);
+            size += shard->devices.size();
+        }
+        return size;
+    }
+
+    DeviceRegistry::Shard& DeviceRegistry::GetShard(boost::string_view deviceName)
+    {
+        return *_shards[ShardIndex(deviceName)];
+    }
+
+    const DeviceRegistry::Shard& DeviceRegistry::GetShard(boost::string_view deviceName) const
+    {
+        return *_shards[ShardIndex(deviceName)];
+    }
+
+    size_t DeviceRegistry::ShardIndex(boost::string_view deviceName) const
+    {
+        // FNV-1a, the same for std::string and string_view names
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : deviceName)
+        {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 1099511628211ull;
+        }
+        return static_cast<size_t>(hash % _shards.size());
+    }
+} // namespace app
\ No newline at end of file
@@ -0,0 +1,78 @@
+﻿#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include <boost/utility/string_view.hpp>
+
+#include "Device.h"
+#include "MembershipFilter.h"
+
+namespace app
+{
+    // Concurrent devices registry: devices are hash-sharded by name, every shard has its own lock.
+    // Updates of devices in different shards don't block each other.
+    // Every change increases the registry version and sets it as the version of the changed device.
+    // Device names are mirrored to a membership filter for lock-free rejection of unknown devices.
+    class DeviceRegistry
+    {
+    public:
+        explicit DeviceRegistry(size_t shardCount = 64, size_t filterCapacity = 100000);
+
+        void Reset(std::vector<Device> devices);
+        bool Insert(Device device);
+        bool Erase(const std::string& deviceName);
+
+        bool Contains(const std::string& deviceName) const;
+        bool Get(const std::string& deviceName, Device& device) const;
+        // Up to limit devices with names greater than *after (from the first device if null)
+        // and starting with prefix, sorted by name
+        std::vector<Device> GetPage(const std::string* after, const std::string& prefix, size_t limit) const;
+        size_t Size() const;
+
+        // Starts from the startup time, so versions don't repeat after restart
+        uint64_t Version() const { return _version.load(); }
+
+        // No false negatives: a name it rejects is not in the registry
+        const MembershipFilter& Filter() const { return _filter; }
+
+        // Calls func(Device&) under the shard lock, returns false if device is unknown
+        template<typename Func>
+        bool Update(boost::string_view deviceName, Func&& func)
+        {
+            Shard& shard = GetShard(deviceName);
+            std::lock_guard<std::shared_timed_mutex> lock(shard.sync);
+
+            auto it = shard.devices.find(deviceName);
+            if (it == shard.devices.end())
+                return false;
+
+            func(it->second);
+            it->second.version = ++_version;
+            return true;
+        }
+
+    private:
+        using Devices = std::map<std::string, Device, std::less<>>; // looked up by string_view too
+
+        struct Shard
+        {
+            mutable std::shared_timed_mutex sync;
+            Devices                         devices;
+        };
+
+        Shard&       GetShard(boost::string_view deviceName);
+        const Shard& GetShard(boost::string_view deviceName) const;
+        size_t       ShardIndex(boost::string_view deviceName) const;
+
+    private:
+        std::vector<std::unique_ptr<Shard>> _shards;
+        std::atomic<uint64_t>               _version;
+        MembershipFilter                    _filter;
+    };
+} // namespace app
\ No newline at end of file
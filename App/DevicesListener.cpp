@@ -0,0 +1,161 @@
+﻿#include "DevicesListener.h"
+
+#include <chrono>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#define poll WSAPoll
+#else
+#include <poll.h>
+#endif
+
+#include <fmt/format.h>
+#include <libpq-fe.h>
+
+#include "Logger.h"
+
+namespace app
+{
+    namespace
+    {
+        constexpr int  PollIntervalMs = 100;
+        constexpr auto RetryInterval  = std::chrono::seconds(1);
+    } // namespace
+
+    DevicesListener::~DevicesListener()
+    {
+        Stop();
+    }
+
+    void DevicesListener::Start(const DBConnectionParams& p, const std::string& instanceId, Callback callback)
+    {
+        _connectString = MakeConnectString(p);
+        _instanceId    = instanceId;
+        _callback      = std::move(callback);
+
+        std::string error;
+        if (!Open(error))
+            throw std::runtime_error("DB listen: " + error);
+        LOG_INFO("DB listen: OK", "channel", DevicesChannel);
+
+        _stop = false;
+        _thread = std::thread(&DevicesListener::Run, this);
+    }
+
+    void DevicesListener::Stop()
+    {
+        _stop = true;
+        if (_thread.joinable())
+            _thread.join();
+        Close();
+    }
+
+    void DevicesListener::Run()
+    {
+        auto retryAt = std::chrono::steady_clock::now();
+        while (!_stop)
+        {
+            if (!_conn || _resync)
+            {
+                // Reconnect or repeat a failed change, not more often than RetryInterval
+                if (std::chrono::steady_clock::now() < retryAt)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(PollIntervalMs));
+                    continue;
+                }
+                retryAt = std::chrono::steady_clock::now() + RetryInterval;
+
+                std::string error;
+                if (!_conn && !Open(error))
+                {
+                    LOG_ERROR("DB listen: reconnect FAILED", "error", error);
+                    continue;
+                }
+                _resync = false;
+                Deliver({ std::string(), DevicesChange::Op::Sync, {} });
+                continue;
+            }
+
+            // poll, not select: a reconnected socket can be above FD_SETSIZE
+            pollfd pfd{};
+            pfd.fd     = PQsocket(_conn);
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, PollIntervalMs) <= 0)
+                continue;
+
+            if (!PQconsumeInput(_conn))
+            {
+                LOG_ERROR("DB listen: connection lost", "error", PQerrorMessage(_conn));
+                Close();
+                _resync = true;
+                continue;
+            }
+
+            while (PGnotify* notify = PQnotifies(_conn))
+            {
+                std::string payload = notify->extra;
+                PQfreemem(notify);
+
+                DevicesChange change;
+                try
+                {
+                    change = ParseDevicesChange(payload);
+                }
+                catch (std::exception& ex)
+                {
+                    LOG_ERROR("DB listen: malformed devices change", "error", ex.what(), "payload", payload);
+                    continue;
+                }
+
+                if (change.instance != _instanceId)
+                    Deliver(change);
+            }
+        }
+    }
+
+    void DevicesListener::Deliver(const DevicesChange& change)
+    {
+        try
+        {
+            _callback(change);
+        }
+        catch (std::exception& ex)
+        {
+            LOG_ERROR("DB listen: apply devices change FAILED, retry as sync", "error", ex.what());
+            _resync = true;
+        }
+    }
+
+    bool DevicesListener::Open(std::string& error)
+    {
+        _conn = PQconnectdb(_connectString.c_str());
+        if (!_conn || PQstatus(_conn) != CONNECTION_OK)
+        {
+            error = _conn ? PQerrorMessage(_conn) : "out of memory";
+            Close();
+            return false;
+        }
+
+        PGresult* result = PQexec(_conn, fmt::format("LISTEN {}", DevicesChannel).c_str());
+        bool isListening = PQresultStatus(result) == PGRES_COMMAND_OK;
+        if (!isListening)
+            error = PQresultErrorMessage(result);
+        PQclear(result);
+        if (!isListening)
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void DevicesListener::Close()
+    {
+        if (_conn)
+        {
+            PQfinish(_conn);
+            _conn = nullptr;
+        }
+    }
+} // namespace app
\ No newline at end of file
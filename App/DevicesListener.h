@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "AppOptions.h"
+#include "DB.h"
+
+struct pg_conn;
+
+namespace app
+{
+    // Provisioning changes of other App instances: LISTEN on DevicesChannel over its own connection.
+    // App instances sharing MQTT messages keep their registries in sync through it.
+    // After a lost connection it reconnects and reports Sync, notifications may have been missed.
+    class DevicesListener
+    {
+    public:
+        // Called on the listener thread; on exception the change is retried as Sync
+        using Callback = std::function<void(const DevicesChange& change)>;
+
+        DevicesListener() = default;
+        ~DevicesListener();
+
+        void Start(const DBConnectionParams& p, const std::string& instanceId, Callback callback); // Throws if LISTEN fails
+        void Stop();
+
+    private:
+        void Run();
+        bool Open(std::string& error);
+        void Close();
+        void Deliver(const DevicesChange& change);
+
+    private:
+        std::string       _connectString;
+        std::string       _instanceId; // own changes are skipped
+        Callback          _callback;
+        pg_conn*          _conn = nullptr;
+        bool              _resync = false; // of the listener thread
+        std::atomic<bool> _stop{ false };
+        std::thread       _thread;
+    };
+} // namespace app
\ No newline at end of file
@@ -0,0 +1,133 @@
+﻿#include "DevicesStream.h"
+
+#include <stdexcept>
+
+namespace app
+{
+    constexpr size_t DevicesStream::ChunkSize;
+
+    namespace
+    {
+        // CBOR initial bytes
+        const char CborIndefiniteArray = '\x9F';
+        const char CborIndefiniteMap   = '\xBF';
+        const char CborBreak           = '\xFF';
+        const char CborText4           = '\x64'; // text string of 4 bytes
+        const char CborText7           = '\x67'; // text string of 7 bytes
+    }
+
+    DevicesStream::DevicesStream(const DeviceRegistry& devices, DeviceQuery query, uint64_t timestamp, size_t threshold, Encoding encoding, int indent)
+        : _cursor(devices, std::move(query), timestamp, threshold)
+        , _encoding(encoding)
+        , _indent(encoding == Encoding::Json ? indent : -1)
+    {
+        if (encoding == Encoding::MsgPack)
+            throw std::invalid_argument("DevicesStream: MessagePack can't be streamed");
+    }
+
+    bool DevicesStream::NextChunk(std::string& chunk)
+    {
+        chunk.clear();
+        if (_finished)
+            return false;
+
+        if (!_started)
+        {
+            _started = true;
+            WriteBegin(chunk);
+        }
+
+        while (chunk.size() < ChunkSize)
+        {
+            if (!_cursor.Next(_device))
+            {
+                WriteEnd(chunk);
+                _finished = true;
+                break;
+            }
+
+            WriteDevice(chunk, _device);
+        }
+        return true;
+    }
+
+    void DevicesStream::WriteBegin(std::string& out) const
+    {
+        if (_encoding == Encoding::Cbor)
+        {
+            out += CborIndefiniteMap;
+            out += CborText7;
+            out += "devices";
+            out += CborIndefiniteArray;
+        }
+        else if (_indent < 0)
+            out += "{\"devices\":[";
+        else
+            out += "{\n" + std::string(_indent, ' ') + "\"devices\": [";
+    }
+
+    void DevicesStream::WriteDevice(std::string& out, const Device& device)
+    {
+        if (_encoding == Encoding::Cbor)
+        {
+            ++_count;
+            Serialize(device, _encoding, -1, out);
+            return;
+        }
+
+        if (_count++ != 0)
+            out += ',';
+
+        std::string jsonDevice = json(device).dump(_indent);
+        if (_indent < 0)
+        {
+            out += jsonDevice;
+            return;
+        }
+
+        // Array items are nested two levels deep
+        std::string padding(2 * _indent, ' ');
+        out += '\n';
+        out += padding;
+        for (char c : jsonDevice)
+        {
+            out += c;
+            if (c == '\n')
+                out += padding;
+        }
+    }
+
+    void DevicesStream::WriteEnd(std::string& out) const
+    {
+        const std::string* next = _cursor.GetNextAfter();
+
+        if (_encoding == Encoding::Cbor)
+        {
+            out += CborBreak; // array
+            if (next)
+            {
+                out += CborText4;
+                out += "next";
+                Serialize(*next, _encoding, -1, out);
+            }
+            out += CborBreak; // map
+        }
+        else if (_indent < 0)
+        {
+            out += ']';
+            if (next)
+                out += ",\"next\":" + json(*next).dump();
+            out += '}';
+        }
+        else
+        {
+            std::string padding(_indent, ' ');
+            if (_count != 0)
+                out += '\n' + padding;
+            out += ']';
+            if (next)
+                out += ",\n" + padding + "\"next\": " + json(*next).dump();
+            out += "\n}";
+        }
+    }
+} // namespace app
\ No newline at end of file
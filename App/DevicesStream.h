@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include <string>
+
+#include "Device.h"
+#include "DeviceQuery.h"
+#include "DeviceRegistry.h"
+#include "Encoding.h"
+
+namespace app
+{
+    // Serializes {"devices":[...], "next":"..."} from registry page by page into chunks of about ChunkSize bytes.
+    // Memory use doesn't depend on devices count. CBOR uses indefinite-length map and array,
+    // MessagePack needs element counts up front and can't be streamed.
+    class DevicesStream
+    {
+    public:
+        static constexpr size_t ChunkSize = 64 * 1024;
+
+        // indent < 0 - compact JSON
+        DevicesStream(const DeviceRegistry& devices, DeviceQuery query, uint64_t timestamp, size_t threshold, Encoding encoding, int indent);
+
+        // Next part of document, returns false when document is complete
+        bool NextChunk(std::string& chunk);
+
+    private:
+        void WriteBegin(std::string& out) const;
+        void WriteDevice(std::string& out, const Device& device);
+        void WriteEnd(std::string& out) const;
+
+    private:
+        DeviceCursor _cursor;
+        Encoding     _encoding;
+        int          _indent;
+
+        Device _device;
+        size_t _count = 0;
+        bool   _started = false;
+        bool   _finished = false;
+    };
+} // namespace app
\ No newline at end of file
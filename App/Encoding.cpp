@@ -0,0 +1,61 @@
+﻿#include "Encoding.h"
+
+namespace app
+{
+    const char* GetContentType(Encoding encoding)
+    {
+        switch (encoding)
+        {
+        case Encoding::Cbor:    return "application/cbor";
+        case Encoding::MsgPack: return "application/msgpack";
+        case Encoding::Json:
+        default:                return "application/json";
+        }
+    }
+
+    const char* GetContentTypeFilter(Encoding encoding)
+    {
+        switch (encoding)
+        {
+        case Encoding::Cbor:    return "application/cbor";
+        case Encoding::MsgPack: return "application/(x-)?msgpack";
+        case Encoding::Json:
+        default:                return "application/json";
+        }
+    }
+
+    void Serialize(const json& j, Encoding encoding, int indent, std::string& out)
+    {
+        switch (encoding)
+        {
+        case Encoding::Cbor:
+            json::to_cbor(j, out);
+            break;
+        case Encoding::MsgPack:
+            json::to_msgpack(j, out);
+            break;
+        case Encoding::Json:
+        default:
+            out += j.dump(indent);
+            break;
+        }
+    }
+
+    std::string Serialize(const json& j, Encoding encoding, int indent)
+    {
+        std::string out;
+        Serialize(j, encoding, indent, out);
+        return out;
+    }
+
+    json Deserialize(const std::vector<uint8_t>& data, Encoding encoding)
+    {
+        switch (encoding)
+        {
+        case Encoding::Cbor:    return json::from_cbor(data);
+        case Encoding::MsgPack: return json::from_msgpack(data);
+        case Encoding::Json:
+        default:                return json::parse(data);
+        }
+    }
+} // namespace app
\ No newline at end of file
@@ -0,0 +1,29 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace app
+{
+    // Body encodings of REST API, negotiated by Accept/Content-Type headers
+    enum class Encoding
+    {
+        Json,
+        Cbor,
+        MsgPack,
+    };
+
+    const char* GetContentType(Encoding encoding);
+    const char* GetContentTypeFilter(Encoding encoding); // regex for restbed method filters
+
+    // indent is used by JSON only, indent < 0 - compact
+    void Serialize(const json& j, Encoding encoding, int indent, std::string& out);
+    std::string Serialize(const json& j, Encoding encoding, int indent = -1);
+    json Deserialize(const std::vector<uint8_t>& data, Encoding encoding);
+
+} // namespace app
\ No newline at end of file
@@ -0,0 +1,102 @@
+﻿#include "FlagRules.h"
+
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+namespace app
+{
+    constexpr int FlagRules::MaxParamId;
+
+    FlagRules::FlagRules(std::vector<Rule> rules)
+    {
+        // Params order, config order of rules within a param is kept
+        std::stable_sort(rules.begin(), rules.end(), [](const Rule& a, const Rule& b) { return a.paramId < b.paramId; });
+
+        int maxParamId = rules.empty() ? -1 : rules.back().paramId;
+        _offsets.assign(static_cast<size_t>(maxParamId + 2), 0);
+        for (const auto& rule : rules)
+            ++_offsets[rule.paramId + 1];
+        for (size_t i = 1; i < _offsets.size(); ++i)
+            _offsets[i] += _offsets[i - 1];
+
+        _rules = std::move(rules);
+    }
+
+    FlagRules FlagRules::Default()
+    {
+        std::vector<Rule> rules;
+        for (size_t i = 0; i < FlagCount; ++i)
+        {
+            const FlagDef& def = FlagTable[i];
+            rules.push_back({ def.paramId, def.paramValueMin, def.paramValueMax, i });
+        }
+        return FlagRules(std::move(rules));
+    }
+
+    FlagRules FlagRules::FromJson(const json& config)
+    {
+        std::vector<Rule> rules;
+        const auto& jsonRules = config.at("rules");
+        for (size_t n = 0; n < jsonRules.size(); ++n)
+        {
+            const auto& jsonRule = jsonRules[n];
+            try
+            {
+                Rule rule;
+                rule.paramId = jsonRule.at("param").get<int>();
+                if (rule.paramId < 0 || rule.paramId > MaxParamId)
+                    throw std::invalid_argument(fmt::format("param out of range [0, {}]", MaxParamId));
+
+                auto flagName = jsonRule.at("flag").get<std::string>();
+                rule.flagIndex = FindFlag(flagName);
+                if (rule.flagIndex == NoFlag)
+                    throw std::invalid_argument(fmt::format("unknown flag: {}", flagName));
+
+                rule.min = INT_MIN;
+                rule.max = INT_MAX;
+                if (jsonRule.count("equals"))
+                    rule.min = rule.max = jsonRule["equals"].get<int>();
+                if (jsonRule.count("min"))
+                    rule.min = std::max(rule.min, jsonRule["min"].get<int>());
+                if (jsonRule.count("max"))
+                    rule.max = std::min(rule.max, jsonRule["max"].get<int>());
+                if (jsonRule.count("greater"))
+                {
+                    int value = jsonRule["greater"].get<int>();
+                    if (value == INT_MAX)
+                        throw std::invalid_argument("condition never matches");
+                    rule.min = std::max(rule.min, value + 1);
+                }
+                if (jsonRule.count("less"))
+                {
+                    int value = jsonRule["less"].get<int>();
+                    if (value == INT_MIN)
+                        throw std::invalid_argument("condition never matches");
+                    rule.max = std::min(rule.max, value - 1);
+                }
+                if (rule.min > rule.max)
+                    throw std::invalid_argument("condition never matches");
+
+                rules.push_back(rule);
+            }
+            catch (std::exception& ex)
+            {
+                throw std::runtime_error(fmt::format("Flag rules: rule {}: {}", n, ex.what()));
+            }
+        }
+        return FlagRules(std::move(rules));
+    }
+
+    FlagRules FlagRules::FromFile(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file)
+            throw std::runtime_error(fmt::format("Flag rules: can't open file: {}", path));
+
+        return FromJson(json::parse(file));
+    }
+} // namespace app
\ No newline at end of file
@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "Device.h"
+
+using json = nlohmann::json;
+
+namespace app
+{
+    // Rules setting flags by MQTT params, compiled into a dense table indexed by paramId.
+    // Rules of a param are checked in config order, the first match wins.
+    //
+    // Config: {"rules": [
+    //     {"param": 1, "equals": 0,           "flag": "flag1"},
+    //     {"param": 2, "greater": 11,         "flag": "flag3"},
+    //     {"param": 3, "min": 10, "max": 20,  "flag": "flag2"}
+    // ]}
+    // Conditions: equals, greater, less, min/max (inclusive range), no condition matches any value.
+    class FlagRules
+    {
+    public:
+        static constexpr int MaxParamId = 65535;
+
+        static FlagRules Default(); // Mapping of FlagTable
+        static FlagRules FromJson(const json& config);
+        static FlagRules FromFile(const std::string& path);
+
+        // Index of flag set by param, NoFlag if no rule matches
+        size_t Match(int paramId, int paramValue) const
+        {
+            if (paramId < 0 || static_cast<size_t>(paramId) + 1 >= _offsets.size())
+                return NoFlag;
+
+            for (size_t i = _offsets[paramId], end = _offsets[paramId + 1]; i < end; ++i)
+            {
+                const Rule& rule = _rules[i];
+                if (paramValue >= rule.min && paramValue <= rule.max)
+                    return rule.flagIndex;
+            }
+            return NoFlag;
+        }
+
+        size_t Size() const { return _rules.size(); }
+
+    private:
+        struct Rule
+        {
+            int    paramId;
+            int    min; // inclusive
+            int    max; // inclusive
+            size_t flagIndex;
+        };
+
+        explicit FlagRules(std::vector<Rule> rules);
+
+    private:
+        std::vector<size_t> _offsets; // rules of paramId are [_offsets[paramId], _offsets[paramId + 1])
+        std::vector<Rule>   _rules;
+    };
+} // namespace app
\ No newline at end of file
@@ -0,0 +1,193 @@
+﻿#include "FlagWriter.h"
+
+#include <algorithm>
+#include <future>
+#include <vector>
+
+#include "Logger.h"
+#include "Metrics.h"
+
+namespace app
+{
+    FlagWriter::FlagWriter(DB& db, AsyncDB& asyncDb)
+        : _db(db)
+        , _asyncDb(asyncDb)
+    {
+    }
+
+    FlagWriter::~FlagWriter()
+    {
+        Stop();
+    }
+
+    void FlagWriter::Start(const DBConnectionParams& p)
+    {
+        _flushInterval = std::chrono::milliseconds(p.flush_interval);
+        _batchSize     = std::max<size_t>(p.flush_batch_size, 1);
+        _stop          = false;
+        _thread        = std::thread(&FlagWriter::Run, this);
+    }
+
+    void FlagWriter::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_sync);
+            _stop = true;
+        }
+        _wakeUp.notify_one();
+
+        if (_thread.joinable())
+            _thread.join();
+    }
+
+    void FlagWriter::Update(const std::string& deviceName, const Device::Flags& flags, const std::bitset<FlagCount>& changed)
+    {
+        size_t dirtyCount;
+        {
+            std::lock_guard<std::mutex> lock(_sync);
+            for (size_t i = 0; i < FlagCount; ++i)
+            {
+                if (changed[i])
+                    _dirty[{ deviceName, i }] = flags[i];
+            }
+            dirtyCount = _dirty.size();
+            Metrics::Instance().dbFlagsPending = dirtyCount;
+        }
+
+        if (dirtyCount >= _batchSize)
+            _wakeUp.notify_one();
+    }
+
+    void FlagWriter::Discard(const std::string& deviceName)
+    {
+        std::lock_guard<std::mutex> lock(_sync);
+
+        auto it = _dirty.lower_bound({ deviceName, 0 });
+        while (it != _dirty.end() && it->first.first == deviceName)
+            it = _dirty.erase(it);
+        Metrics::Instance().dbFlagsPending = _dirty.size();
+    }
+
+    void FlagWriter::DiscardAll()
+    {
+        std::lock_guard<std::mutex> lock(_sync);
+        _dirty.clear();
+        Metrics::Instance().dbFlagsPending = 0;
+    }
+
+    void FlagWriter::Run()
+    {
+        std::unique_lock<std::mutex> lock(_sync);
+        while (!_stop)
+        {
+            _wakeUp.wait_for(lock, _flushInterval, [this] { return _stop || _dirty.size() >= _batchSize; });
+
+            Flags flags;
+            flags.swap(_dirty);
+            Metrics::Instance().dbFlagsPending = 0;
+
+            lock.unlock();
+            Flush(std::move(flags));
+            lock.lock();
+        }
+
+        // Drain on shutdown
+        Flags flags;
+        flags.swap(_dirty);
+        Metrics::Instance().dbFlagsPending = 0;
+        lock.unlock();
+        Flush(std::move(flags));
+    }
+
+    void FlagWriter::Flush(Flags flags)
+    {
+        if (_asyncDb.IsConnected())
+        {
+            FlushAsync(flags);
+            return;
+        }
+
+        Flags::const_iterator it = flags.begin();
+        while (it != flags.end())
+        {
+            auto batchBegin = it;
+            auto updates = MakeUpdates(it, flags.end());
+
+            try
+            {
+                _db.UpdateFlags(updates);
+            }
+            catch (std::exception& ex)
+            {
+                LOG_ERROR("FlagWriter: flush failed", "error", ex.what());
+                Retry(batchBegin, flags.end());
+                return;
+            }
+        }
+    }
+
+    void FlagWriter::FlushAsync(Flags& flags)
+    {
+        struct Batch
+        {
+            Flags::const_iterator begin;
+            Flags::const_iterator end;
+            std::future<void>     done;
+        };
+
+        // Batches are pipelined, not sent one round trip after another
+        std::vector<Batch> batches;
+        Flags::const_iterator it = flags.begin();
+        while (it != flags.end())
+        {
+            Batch batch;
+            batch.begin = it;
+            auto updates = MakeUpdates(it, flags.end());
+            batch.end  = it;
+            batch.done = _asyncDb.UpdateFlags(updates);
+            batches.push_back(std::move(batch));
+        }
+
+        for (auto& batch : batches)
+        {
+            try
+            {
+                batch.done.get();
+            }
+            catch (std::exception& ex)
+            {
+                LOG_ERROR("FlagWriter: flush failed", "error", ex.what());
+                Retry(batch.begin, batch.end);
+            }
+        }
+    }
+
+    std::vector<FlagUpdate> FlagWriter::MakeUpdates(Flags::const_iterator& it, Flags::const_iterator end) const
+    {
+        std::vector<FlagUpdate> updates;
+        updates.reserve(_batchSize);
+        for (; it != end && updates.size() < _batchSize; ++it)
+        {
+            FlagUpdate update;
+            update.deviceName = it->first.first;
+            update.flagName   = FlagTable[it->first.second].name;
+            update.value      = it->second.value;
+            update.timestamp  = it->second.timestamp;
+            updates.push_back(std::move(update));
+        }
+        return updates;
+    }
+
+    void FlagWriter::Retry(Flags::const_iterator begin, Flags::const_iterator end)
+    {
+        // Keep failed updates for the next flush unless they were overwritten meanwhile
+        std::lock_guard<std::mutex> lock(_sync);
+        if (_stop)
+        {
+            LOG_ERROR("FlagWriter: dropped updates", "count", std::distance(begin, end));
+            return;
+        }
+        _dirty.insert(begin, end);
+        Metrics::Instance().dbFlagsPending = _dirty.size();
+    }
+} // namespace app
\ No newline at end of file
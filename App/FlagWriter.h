@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "AppOptions.h"
+#include "AsyncDB.h"
+#include "DB.h"
+#include "Device.h"
+
+namespace app
+{
+    // Write-behind stage for flags: updates are coalesced per device and flag in memory
+    // and flushed to DB in batches, periodically or when enough flags are dirty.
+    // With async DB connections all batches of a flush are in flight at once.
+    class FlagWriter
+    {
+    public:
+        FlagWriter(DB& db, AsyncDB& asyncDb);
+        ~FlagWriter();
+
+        void Start(const DBConnectionParams& p);
+        void Stop(); // Flushes all pending updates
+
+        // Flags of the device in changed, one lock per device and message
+        void Update(const std::string& deviceName, const Device::Flags& flags, const std::bitset<FlagCount>& changed);
+        void Discard(const std::string& deviceName); // Drops pending updates of a deleted device
+        void DiscardAll();
+
+    private:
+        using FlagKey = std::pair<std::string, size_t>; // device name, flag index
+        using Flags   = std::map<FlagKey, Device::Flag>;
+
+        void Run();
+        void Flush(Flags flags);
+        void FlushAsync(Flags& flags);
+        std::vector<FlagUpdate> MakeUpdates(Flags::const_iterator& it, Flags::const_iterator end) const; // Next batch
+        void Retry(Flags::const_iterator begin, Flags::const_iterator end); // Keeps failed updates for the next flush
+
+    private:
+        DB&      _db;
+        AsyncDB& _asyncDb;
+
+        std::chrono::milliseconds _flushInterval{ 1000 };
+        size_t                    _batchSize = 1000;
+
+        Flags                   _dirty;
+        std::mutex              _sync;
+        std::condition_variable _wakeUp;
+        bool                    _stop = false;
+        std::thread             _thread;
+    };
+} // namespace app
\ No newline at end of file
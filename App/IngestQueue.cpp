@@ -0,0 +1,355 @@
+﻿#include "IngestQueue.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+#include "Metrics.h"
+
+namespace app
+{
+    namespace
+    {
+        constexpr auto IdleWait  = std::chrono::milliseconds(10);
+        constexpr size_t CoalesceShards = 16;
+        constexpr size_t CoalesceKeysPerMessage = 8; // keys capacity per queued message, beyond it params aren't coalesced
+    } // namespace
+
+    // Keys of queued params: hash-sharded open addressing sets of 64-bit keys, allocated once.
+    // A shard lock is held for a few probes, producers of different params rarely meet.
+    class IngestQueue::CoalesceKeys
+    {
+    public:
+        enum class Result { Inserted, Exists, Full };
+
+        explicit CoalesceKeys(size_t capacity)
+        {
+            // A shard fills up to 3/4 of twice its share
+            size_t slots = 16;
+            while (slots < 2 * capacity / CoalesceShards)
+                slots <<= 1;
+            for (auto& shard : _shards)
+                shard.slots.assign(slots, 0);
+        }
+
+        Result Insert(uint64_t key)
+        {
+            Shard& shard = _shards[key % CoalesceShards];
+            std::lock_guard<std::mutex> lock(shard.sync);
+
+            size_t mask = shard.slots.size() - 1;
+            for (size_t i = Home(key, mask); ; i = (i + 1) & mask)
+            {
+                if (shard.slots[i] == key)
+                    return Result::Exists;
+                if (shard.slots[i] == 0)
+                {
+                    if (shard.size >= shard.slots.size() / 4 * 3)
+                        return Result::Full;
+                    shard.slots[i] = key;
+                    ++shard.size;
+                    return Result::Inserted;
+                }
+            }
+        }
+
+        void Erase(uint64_t key)
+        {
+            Shard& shard = _shards[key % CoalesceShards];
+            std::lock_guard<std::mutex> lock(shard.sync);
+
+            size_t mask = shard.slots.size() - 1;
+            size_t i = Home(key, mask);
+            while (shard.slots[i] != key)
+            {
+                if (shard.slots[i] == 0)
+                    return;
+                i = (i + 1) & mask;
+            }
+
+            // Backward shift: keys after the hole move to it unless they'd pass their home slot
+            for (size_t j = (i + 1) & mask; shard.slots[j] != 0; j = (j + 1) & mask)
+            {
+                if (((j - Home(shard.slots[j], mask)) & mask) >= ((j - i) & mask))
+                {
+                    shard.slots[i] = shard.slots[j];
+                    i = j;
+                }
+            }
+            shard.slots[i] = 0;
+            --shard.size;
+        }
+
+    private:
+        static size_t Home(uint64_t key, size_t mask) { return static_cast<size_t>(key >> 32) & mask; }
+
+        struct Shard
+        {
+            std::mutex            sync;
+            std::vector<uint64_t> slots; // 0 is empty
+            size_t                size = 0;
+        };
+        std::array<Shard, CoalesceShards> _shards;
+    };
+
+    IngestOverflow ParseIngestOverflow(const std::string& name)
+    {
+        if (name == "block")
+            return IngestOverflow::Block;
+        if (name == "drop_oldest")
+            return IngestOverflow::DropOldest;
+        if (name == "coalesce")
+            return IngestOverflow::Coalesce;
+        throw std::invalid_argument(fmt::format("Unknown ingest overflow policy: \"{}\"", name));
+    }
+
+    IngestQueue::IngestQueue() = default;
+
+    IngestQueue::~IngestQueue()
+    {
+        Stop();
+    }
+
+    void IngestQueue::Start(const AppParams& p, BatchHandler handler)
+    {
+        _overflow  = ParseIngestOverflow(p.ingest_overflow);
+        _batchSize = std::max<size_t>(p.ingest_batch_size, 1);
+        _handler   = std::move(handler);
+        _queue.reset(new BoundedQueue<MessagePtr>(std::max<size_t>(p.ingest_queue_size, 1)));
+        _pool.reset(new BoundedQueue<MessagePtr>(_queue->Capacity()));
+        if (_overflow == IngestOverflow::Coalesce)
+            _queued.reset(new CoalesceKeys(_queue->Capacity() * CoalesceKeysPerMessage));
+        _stop      = false;
+
+        for (size_t i = 0; i < std::max<size_t>(p.ingest_workers, 1); ++i)
+            _workers.emplace_back(&IngestQueue::Run, this);
+    }
+
+    void IngestQueue::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_sync);
+            _stop = true;
+        }
+        _wakeUp.notify_all();
+        _freeSpace.notify_all();
+
+        for (auto& worker : _workers)
+            worker.join();
+        _workers.clear();
+    }
+
+    void IngestQueue::Push(const DevMessage& message)
+    {
+        auto& metrics = Metrics::Instance();
+
+        // Copied into a recycled message: the arena and records reuse their capacity
+        MessagePtr queued = Acquire();
+        for (const auto& item : message)
+        {
+            auto devName = message.DevName(item);
+            uint64_t key = 0;
+            if (_queued)
+            {
+                key = CoalesceKey(devName, item.paramId, item.paramValue);
+                auto result = _queued->Insert(key);
+                if (result == CoalesceKeys::Result::Exists)
+                {
+                    // Same effect as the queued param: the flag timestamp is taken on processing
+                    ++metrics.ingestCoalesced;
+                    continue;
+                }
+                if (result == CoalesceKeys::Result::Full)
+                    key = 0; // queued without coalescing
+                queued->keys.push_back(key);
+            }
+            queued->message.Add(devName.data(), devName.size(), item.paramId, item.paramValue);
+        }
+
+        if (queued->message.Empty())
+        {
+            Release(std::move(queued));
+            return;
+        }
+        PushMessage(queued);
+        WakeUp();
+    }
+
+    void IngestQueue::PushMessage(MessagePtr& queued)
+    {
+        auto& metrics = Metrics::Instance();
+
+        if (!TryPush(queued))
+        {
+            ++metrics.ingestOverflows;
+            switch (_overflow)
+            {
+            case IngestOverflow::DropOldest:
+                do
+                {
+                    MessagePtr oldest;
+                    if (_queue->TryPop(oldest))
+                    {
+                        metrics.mqttItemsPending -= oldest->message.Size();
+                        Drop(oldest);
+                    }
+                } while (!TryPush(queued));
+                break;
+
+            case IngestOverflow::Block:
+            case IngestOverflow::Coalesce:
+                for (;;)
+                {
+                    std::unique_lock<std::mutex> lock(_sync);
+                    if (_stop)
+                    {
+                        Drop(queued);
+                        return;
+                    }
+                    if (_idle.load(std::memory_order_relaxed) != 0)
+                        _wakeUp.notify_all();
+
+                    // Re-check after the blocked mark: a worker popping later sees it and notifies
+                    ++_blocked;
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    bool pushed = TryPush(queued);
+                    if (!pushed)
+                        _freeSpace.wait_for(lock, IdleWait);
+                    --_blocked;
+                    if (pushed || TryPush(queued))
+                        break;
+                }
+                break;
+            }
+        }
+    }
+
+    void IngestQueue::Drop(MessagePtr& queued)
+    {
+        EraseKeys(*queued);
+        Metrics::Instance().ingestDropped += queued->message.Size();
+        Release(std::move(queued));
+    }
+
+    void IngestQueue::EraseKeys(const QueuedMessage& queued)
+    {
+        for (uint64_t key : queued.keys)
+        {
+            if (key != 0)
+                _queued->Erase(key);
+        }
+    }
+
+    IngestQueue::MessagePtr IngestQueue::Acquire()
+    {
+        MessagePtr queued;
+        if (!_pool->TryPop(queued))
+            queued.reset(new QueuedMessage());
+        return queued;
+    }
+
+    void IngestQueue::Release(MessagePtr queued)
+    {
+        queued->message.Clear();
+        queued->keys.clear();
+        _pool->TryPush(std::move(queued)); // freed if the pool is full
+    }
+
+    void IngestQueue::WakeUp()
+    {
+        // Pairs with the fence of an idle worker: either it sees the params or we see it idle
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_idle.load(std::memory_order_relaxed) != 0)
+        {
+            std::lock_guard<std::mutex> lock(_sync);
+            _wakeUp.notify_all();
+        }
+    }
+
+    bool IngestQueue::TryPush(MessagePtr& queued)
+    {
+        // Moved only on success
+        size_t size = queued->message.Size();
+        if (!_queue->TryPush(std::move(queued)))
+            return false;
+
+        Metrics::Instance().mqttItemsPending += size;
+        return true;
+    }
+
+    void IngestQueue::Run()
+    {
+        auto& metrics = Metrics::Instance();
+
+        std::vector<MessagePtr> messages;
+        Batch batch;
+        for (;;)
+        {
+            // Whole messages up to the batch size in params
+            size_t params = 0;
+            MessagePtr queued;
+            while (params < _batchSize && _queue->TryPop(queued))
+            {
+                if (_queued)
+                    EraseKeys(*queued);
+                params += queued->message.Size();
+                batch.push_back(&queued->message);
+                messages.push_back(std::move(queued));
+            }
+
+            if (messages.empty())
+            {
+                std::unique_lock<std::mutex> lock(_sync);
+                if (_stop)
+                    return; // queue is drained
+
+                // Re-check after the idle mark: a producer pushing later sees it and notifies
+                ++_idle;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (_queue->Size() == 0)
+                    _wakeUp.wait_for(lock, IdleWait);
+                --_idle;
+                continue;
+            }
+
+            // Pairs with the fence of a blocked producer: either it sees the free space or we see it blocked
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_blocked.load(std::memory_order_relaxed) != 0)
+            {
+                std::lock_guard<std::mutex> lock(_sync);
+                _freeSpace.notify_all();
+            }
+
+            metrics.mqttItemsPending -= params;
+            ++metrics.ingestBatches;
+            _handler(batch);
+
+            for (auto& message : messages)
+                Release(std::move(message));
+            messages.clear();
+            batch.clear();
+        }
+    }
+
+    uint64_t IngestQueue::CoalesceKey(boost::string_view devName, int paramId, int paramValue)
+    {
+        // FNV-1a of the name, then param id and value, with a final mix.
+        // Distinct params share a key with ~2^-64 probability, then one of them is coalesced away.
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : devName)
+        {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 1099511628211ull;
+        }
+        hash ^= (static_cast<uint64_t>(static_cast<uint32_t>(paramId)) << 32) | static_cast<uint32_t>(paramValue);
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 33;
+        return hash != 0 ? hash : 1;
+    }
+} // namespace app
\ No newline at end of file
@@ -0,0 +1,86 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/utility/string_view.hpp>
+
+#include "AppOptions.h"
+#include "BoundedQueue.h"
+#include "Mqtt.h"
+
+namespace app
+{
+    enum class IngestOverflow
+    {
+        Block,      // producer waits for free space: backpressure to the MQTT connection
+        DropOldest, // oldest queued message is dropped
+        Coalesce,   // params equal to a queued one are dropped, the rest wait
+    };
+
+    IngestOverflow ParseIngestOverflow(const std::string& name); // block|drop_oldest|coalesce, throws std::invalid_argument
+
+    // Ingest pipeline between MQTT and the devices state: a bounded lock-free queue of whole messages
+    // fed by the MQTT threads and drained in batches by a pool of ingest workers, off the REST runloop.
+    // Queued messages keep the arena layout of DevMessage and are recycled, so steady state doesn't allocate.
+    class IngestQueue
+    {
+    public:
+        using Batch        = std::vector<const DevMessage*>;
+        using BatchHandler = std::function<void(const Batch& batch)>;
+
+        IngestQueue();
+        ~IngestQueue();
+
+        void Start(const AppParams& p, BatchHandler handler);
+        void Stop(); // Processes queued messages
+
+        void Push(const DevMessage& message);
+
+    private:
+        struct QueuedMessage
+        {
+            DevMessage            message;
+            std::vector<uint64_t> keys; // coalesce keys of items, 0 if not tracked
+        };
+        using MessagePtr = std::unique_ptr<QueuedMessage>;
+
+        class CoalesceKeys;
+
+        void Run();
+        void PushMessage(MessagePtr& queued);
+        void WakeUp();
+        bool TryPush(MessagePtr& queued);
+        void Drop(MessagePtr& queued);
+        void EraseKeys(const QueuedMessage& queued);
+        MessagePtr Acquire();
+        void Release(MessagePtr queued);
+        static uint64_t CoalesceKey(boost::string_view devName, int paramId, int paramValue);
+
+    private:
+        IngestOverflow _overflow = IngestOverflow::Block;
+        size_t         _batchSize = 256;
+        BatchHandler   _handler;
+
+        std::unique_ptr<BoundedQueue<MessagePtr>> _queue;
+        std::unique_ptr<BoundedQueue<MessagePtr>> _pool; // processed messages for reuse
+
+        // Workers sleep on empty queue, producers notify only when some worker is idle.
+        // Blocked producers sleep on full queue, workers notify only when some producer is blocked.
+        std::mutex               _sync;
+        std::condition_variable  _wakeUp;
+        std::condition_variable  _freeSpace;
+        std::atomic<size_t>      _idle{ 0 };
+        std::atomic<size_t>      _blocked{ 0 };
+        std::atomic<bool>        _stop{ false };
+        std::vector<std::thread> _workers;
+
+        // Coalesce: keys of queued params
+        std::unique_ptr<CoalesceKeys> _queued;
+    };
+} // namespace app
\ No newline at end of file
@@ -0,0 +1,186 @@
+﻿#include "Logger.h"
+
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+#include <fmt/chrono.h>
+
+#include "Metrics.h"
+
+namespace app
+{
+    namespace
+    {
+        const char* LevelNames[] = { "debug", "info", "warning", "error", "off" };
+
+        constexpr size_t WriteBatch = 1024;
+        constexpr auto   IdleSleep  = std::chrono::milliseconds(10);
+
+        bool NeedsQuotes(fmt::string_view value)
+        {
+            if (value.size() == 0)
+                return true;
+
+            for (char c : value)
+            {
+                if (c <= ' ' || c == '=' || c == '"' || c == '\\')
+                    return true;
+            }
+            return false;
+        }
+    } // namespace
+
+    LogLevel ParseLogLevel(const std::string& name)
+    {
+        for (size_t i = 0; i < sizeof(LevelNames) / sizeof(LevelNames[0]); ++i)
+        {
+            if (name == LevelNames[i])
+                return static_cast<LogLevel>(i);
+        }
+        throw std::invalid_argument(fmt::format("Unknown log level: \"{}\"", name));
+    }
+
+    bool LogRateLimit::Allow(size_t limit, uint64_t& suppressed)
+    {
+        if (limit != 0)
+        {
+            using namespace std::chrono;
+            int64_t second = duration_cast<seconds>(steady_clock::now().time_since_epoch()).count();
+
+            // Approximate: records racing with the window change may be counted in either window
+            int64_t current = _second.load(std::memory_order_relaxed);
+            if (current != second && _second.compare_exchange_strong(current, second, std::memory_order_relaxed))
+                _count.store(0, std::memory_order_relaxed);
+
+            if (_count.fetch_add(1, std::memory_order_relaxed) >= limit)
+            {
+                _suppressed.fetch_add(1, std::memory_order_relaxed);
+                Metrics::Instance().logSuppressed.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+
+        suppressed = _suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    Logger& Logger::Instance()
+    {
+        static Logger logger;
+        return logger;
+    }
+
+    Logger::~Logger()
+    {
+        Stop();
+    }
+
+    void Logger::Start(LogLevel level, size_t queueSize, size_t rateLimit)
+    {
+        Stop();
+
+        _level = level;
+        _rateLimit = rateLimit;
+        _queue.reset(new BoundedQueue<Record>(queueSize));
+        _running = true;
+        _thread = std::thread([this]() { Run(); });
+    }
+
+    void Logger::Stop()
+    {
+        _running = false;
+        if (_thread.joinable())
+            _thread.join();
+    }
+
+    void Logger::AppendField(std::string& text, const char* key, fmt::string_view value)
+    {
+        if (!text.empty())
+            text += ' ';
+        text += key;
+        text += '=';
+
+        if (!NeedsQuotes(value))
+        {
+            text.append(value.data(), value.size());
+            return;
+        }
+
+        text += '"';
+        for (char c : value)
+        {
+            switch (c)
+            {
+            case '"':  text += "\\\""; break;
+            case '\\': text += "\\\\"; break;
+            case '\n': text += "\\n";  break;
+            case '\r': text += "\\r";  break;
+            case '\t': text += "\\t";  break;
+            default:   text += c;      break;
+            }
+        }
+        text += '"';
+    }
+
+    void Logger::Push(LogLevel level, std::string&& text)
+    {
+        using namespace std::chrono;
+
+        Record record;
+        record.timestamp = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+        record.level = level;
+        record.text = std::move(text);
+
+        if (!_running.load(std::memory_order_acquire))
+        {
+            std::string out;
+            Format(record, out);
+            std::cout << out << std::flush;
+            return;
+        }
+
+        if (!_queue->TryPush(std::move(record)))
+            Metrics::Instance().logDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Logger::Run()
+    {
+        std::string out;
+        Record record;
+        for (;;)
+        {
+            // Queued records are written after stop
+            bool running = _running.load(std::memory_order_acquire);
+
+            size_t count = 0;
+            while (count < WriteBatch && _queue->TryPop(record))
+            {
+                Format(record, out);
+                ++count;
+            }
+
+            if (!out.empty())
+            {
+                std::cout.write(out.data(), out.size());
+                std::cout.flush();
+                out.clear();
+            }
+
+            if (count == 0)
+            {
+                if (!running)
+                    break;
+                std::this_thread::sleep_for(IdleSleep);
+            }
+        }
+    }
+
+    void Logger::Format(const Record& record, std::string& out)
+    {
+        std::time_t seconds = static_cast<std::time_t>(record.timestamp / 1000000);
+        fmt::format_to(std::back_inserter(out), "time={:%Y-%m-%dT%H:%M:%S}.{:06}Z level={} {}\n",
+            fmt::gmtime(seconds), record.timestamp % 1000000, LevelNames[static_cast<size_t>(record.level)], record.text);
+    }
+} // namespace app
\ No newline at end of file
@@ -0,0 +1,123 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <fmt/format.h>
+
+#include "BoundedQueue.h"
+
+namespace app
+{
+    enum class LogLevel { Debug, Info, Warning, Error, Off };
+
+    LogLevel ParseLogLevel(const std::string& name); // debug|info|warning|error|off, throws std::invalid_argument
+
+    // Limit of records per second of a call site. Records over the limit are counted
+    // and reported in the next written record of the site.
+    class LogRateLimit
+    {
+    public:
+        // Returns false to skip the record, suppressed - skipped since the last written record
+        bool Allow(size_t limit, uint64_t& suppressed);
+
+    private:
+        std::atomic<int64_t>  _second{ -1 };
+        std::atomic<uint64_t> _count{ 0 };
+        std::atomic<uint64_t> _suppressed{ 0 };
+    };
+
+    // Leveled logfmt logger. Records are formatted by the caller and written to stdout by
+    // a background thread through a lock-free ring, so workers never wait for the stream.
+    // A record is dropped (and counted in metrics) when the ring is full.
+    class Logger
+    {
+    public:
+        static Logger& Instance();
+        ~Logger();
+
+        // Until started records are written synchronously
+        void Start(LogLevel level, size_t queueSize, size_t rateLimit);
+        void Stop(); // Writes queued records
+
+        bool Enabled(LogLevel level) const { return level >= _level.load(std::memory_order_relaxed); }
+        size_t RateLimit() const { return _rateLimit.load(std::memory_order_relaxed); }
+
+        // Fields are key, value pairs
+        template<typename... Fields>
+        void Write(LogLevel level, uint64_t suppressed, const char* message, const Fields&... fields)
+        {
+            static_assert(sizeof...(Fields) % 2 == 0, "Log fields are key, value pairs");
+
+            std::string text;
+            AppendField(text, "msg", fmt::string_view(message));
+            AppendFields(text, fields...);
+            if (suppressed != 0)
+                AppendField(text, "suppressed", suppressed);
+            Push(level, std::move(text));
+        }
+
+    private:
+        Logger() = default;
+
+        struct Record
+        {
+            int64_t     timestamp = 0; // us since epoch
+            LogLevel    level = LogLevel::Info;
+            std::string text;
+        };
+
+        static void AppendFields(std::string&) {}
+
+        template<typename Value, typename... Rest>
+        static void AppendFields(std::string& text, const char* key, const Value& value, const Rest&... rest)
+        {
+            AppendField(text, key, value);
+            AppendFields(text, rest...);
+        }
+
+        template<typename Value>
+        static void AppendField(std::string& text, const char* key, const Value& value)
+        {
+            AppendField(text, key, fmt::string_view(fmt::format("{}", value)));
+        }
+        static void AppendField(std::string& text, const char* key, const std::string& value) { AppendField(text, key, fmt::string_view(value)); }
+        static void AppendField(std::string& text, const char* key, const char* value)        { AppendField(text, key, fmt::string_view(value)); }
+        static void AppendField(std::string& text, const char* key, fmt::string_view value);
+
+        void Push(LogLevel level, std::string&& text);
+        void Run();
+        static void Format(const Record& record, std::string& out);
+
+    private:
+        std::atomic<LogLevel> _level{ LogLevel::Info };
+        std::atomic<size_t>   _rateLimit{ 0 };
+
+        std::unique_ptr<BoundedQueue<Record>> _queue;
+        std::atomic<bool>                     _running{ false };
+        std::thread                           _thread;
+    };
+} // namespace app
+
+// Arguments are evaluated only when the level is enabled:
+//   LOG_INFO("Create devices", "count", devicesIds.size());
+#define APP_LOG(level, ...)                                                                 \
+    do                                                                                      \
+    {                                                                                       \
+        auto& appLogger_ = ::app::Logger::Instance();                                       \
+        if (appLogger_.Enabled(level))                                                      \
+        {                                                                                   \
+            static ::app::LogRateLimit appLogLimit_;                                        \
+            uint64_t appLogSuppressed_ = 0;                                                 \
+            if (appLogLimit_.Allow(appLogger_.RateLimit(), appLogSuppressed_))              \
+                appLogger_.Write(level, appLogSuppressed_, __VA_ARGS__);                    \
+        }                                                                                   \
+    } while (0)
+
+#define LOG_DEBUG(...)   APP_LOG(::app::LogLevel::Debug,   __VA_ARGS__)
+#define LOG_INFO(...)    APP_LOG(::app::LogLevel::Info,    __VA_ARGS__)
+#define LOG_WARNING(...) APP_LOG(::app::LogLevel::Warning, __VA_ARGS__)
+#define LOG_ERROR(...)   APP_LOG(::app::LogLevel::Error,   __VA_ARGS__)
\ No newline at end of file
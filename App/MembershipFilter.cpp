@@ -0,0 +1,81 @@
+﻿#include "MembershipFilter.h"
+
+#include <limits>
+
+namespace app
+{
+    namespace
+    {
+        constexpr size_t CountersPerName = 16; // ~0.1-0.3% false positives at capacity with 4 hashes
+    } // namespace
+
+    MembershipFilter::MembershipFilter(size_t capacity)
+    {
+        size_t blocks = capacity * CountersPerName / BlockSize + 1;
+        _blockCount = 1;
+        while (_blockCount < blocks)
+            _blockCount <<= 1;
+        _blockMask = _blockCount - 1;
+
+        _blocks.reset(new Block[_blockCount]);
+        Clear();
+    }
+
+    void MembershipFilter::Add(boost::string_view name)
+    {
+        uint64_t hash = Hash(name);
+        Block& block = _blocks[hash & _blockMask];
+        for (size_t i = 0; i < HashCount; ++i)
+        {
+            auto& counter = block.counters[Slot(hash, i)];
+            uint8_t value = counter.load(std::memory_order_relaxed);
+            while (value != std::numeric_limits<uint8_t>::max() &&
+                   !counter.compare_exchange_weak(value, value + 1, std::memory_order_relaxed))
+            {
+            }
+        }
+    }
+
+    void MembershipFilter::Remove(boost::string_view name)
+    {
+        uint64_t hash = Hash(name);
+        Block& block = _blocks[hash & _blockMask];
+        for (size_t i = 0; i < HashCount; ++i)
+        {
+            // Saturated counters lost their count, keep them
+            auto& counter = block.counters[Slot(hash, i)];
+            uint8_t value = counter.load(std::memory_order_relaxed);
+            while (value != 0 && value != std::numeric_limits<uint8_t>::max() &&
+                   !counter.compare_exchange_weak(value, value - 1, std::memory_order_relaxed))
+            {
+            }
+        }
+    }
+
+    void MembershipFilter::Clear()
+    {
+        for (size_t i = 0; i < _blockCount; ++i)
+        {
+            for (auto& counter : _blocks[i].counters)
+                counter.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t MembershipFilter::Hash(boost::string_view name)
+    {
+        // FNV-1a with the splitmix64 finalizer to spread short names over all bits
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : name)
+        {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 1099511628211ull;
+        }
+
+        hash ^= hash >> 30;
+        hash *= 0xbf58476d1ce4e5b9ull;
+        hash ^= hash >> 27;
+        hash *= 0x94d049bb133111ebull;
+        hash ^= hash >> 31;
+        return hash;
+    }
+} // namespace app
\ No newline at end of file
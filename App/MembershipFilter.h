@@ -0,0 +1,55 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include <boost/utility/string_view.hpp>
+
+namespace app
+{
+    // Lock-free counting Bloom filter of device names: no false negatives, rare false positives.
+    // Blocked layout: all counters of a name are in one cache line-sized block, so a lookup touches
+    // one or two cache lines.
+    // Counters saturate at 255 and then are never decreased.
+    class MembershipFilter
+    {
+    public:
+        explicit MembershipFilter(size_t capacity); // expected names, more degrade the false positive rate
+
+        void Add(boost::string_view name);
+        void Remove(boost::string_view name); // only names that were added
+        void Clear();
+
+        bool MayContain(boost::string_view name) const
+        {
+            uint64_t hash = Hash(name);
+            const Block& block = _blocks[hash & _blockMask];
+            for (size_t i = 0; i < HashCount; ++i)
+            {
+                if (block.counters[Slot(hash, i)].load(std::memory_order_relaxed) == 0)
+                    return false;
+            }
+            return true;
+        }
+
+    private:
+        static constexpr size_t BlockSize = 64; // counters per block
+        static constexpr size_t HashCount = 4;
+
+        struct Block
+        {
+            std::atomic<uint8_t> counters[BlockSize];
+        };
+
+        static uint64_t Hash(boost::string_view name);
+
+        // Block is selected by the low bits, slots by 6-bit groups of the high bits
+        static size_t Slot(uint64_t hash, size_t i) { return (hash >> (64 - 6 * (i + 1))) & (BlockSize - 1); }
+
+    private:
+        size_t                   _blockCount;
+        size_t                   _blockMask;
+        std::unique_ptr<Block[]> _blocks;
+    };
+} // namespace app
\ No newline at end of file
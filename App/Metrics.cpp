@@ -0,0 +1,115 @@
+﻿#include "Metrics.h"
+
+#include <fmt/format.h>
+
+namespace app
+{
+    namespace
+    {
+        const char* HttpMethodNames[] = { "GET", "POST", "DELETE" };
+        const char* DbMethodNames[] = { "CreateDevices", "ReadDevices", "UpdateFlags", "DeleteDevices", "DeleteAllDevices", "PurgeOrphanFlags" };
+
+        void WriteHeader(std::string& out, const char* name, const char* help, const char* type)
+        {
+            out += fmt::format("# HELP {0} {1}\n# TYPE {0} {2}\n", name, help, type);
+        }
+
+        template<typename T>
+        void WriteValue(std::string& out, const char* name, const char* help, const char* type, const std::atomic<T>& value)
+        {
+            WriteHeader(out, name, help, type);
+            out += fmt::format("{} {}\n", name, value.load(std::memory_order_relaxed));
+        }
+
+        void WriteCounter(std::string& out, const char* name, const char* help, const std::atomic<uint64_t>& value)
+        {
+            WriteValue(out, name, help, "counter", value);
+        }
+
+        void WriteGauge(std::string& out, const char* name, const char* help, const std::atomic<int64_t>& value)
+        {
+            WriteValue(out, name, help, "gauge", value);
+        }
+    } // namespace
+
+    constexpr size_t Histogram::MinBits;
+    constexpr size_t Histogram::MaxBits;
+    constexpr size_t Histogram::SubBits;
+    constexpr size_t Histogram::SubCount;
+    constexpr size_t Histogram::BucketCount;
+
+    void Histogram::Write(std::string& out, const char* name, const std::string& labels) const
+    {
+        std::string prefix = labels.empty() ? "" : labels + ",";
+        uint64_t count = 0;
+        for (size_t i = 0; i < BucketCount; ++i)
+        {
+            count += _buckets[i].load(std::memory_order_relaxed);
+            if (i + 1 < BucketCount)
+            {
+                double le = static_cast<double>(UpperBound(i)) / 1e9;
+                out += fmt::format("{}_bucket{{{}le=\"{}\"}} {}\n", name, prefix, le, count);
+            }
+            else
+            {
+                out += fmt::format("{}_bucket{{{}le=\"+Inf\"}} {}\n", name, prefix, count);
+            }
+        }
+
+        std::string braces = labels.empty() ? "" : "{" + labels + "}";
+        out += fmt::format("{}_sum{} {}\n", name, braces, static_cast<double>(_sum.load(std::memory_order_relaxed)) / 1e9);
+        out += fmt::format("{}_count{} {}\n", name, braces, count);
+    }
+
+    Metrics& Metrics::Instance()
+    {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    std::string Metrics::ToPrometheus() const
+    {
+        std::string out;
+        WriteCounter(out, "app_http_connections_total",          "HTTP connections served at least one request", httpConnections);
+        WriteCounter(out, "app_http_requests_total",             "HTTP requests",                                httpRequests);
+        WriteCounter(out, "app_http_reused_requests_total",      "HTTP requests on kept-alive connections",      httpReusedRequests);
+        WriteCounter(out, "app_http_closed_by_limit_total",      "HTTP connections closed by max requests",      httpClosedByLimit);
+        WriteCounter(out, "app_http_cache_hits_total",           "GET devices responses from cache",             httpCacheHits);
+        WriteCounter(out, "app_http_cache_misses_total",         "GET devices responses serialized",             httpCacheMisses);
+        WriteCounter(out, "app_http_not_modified_total",         "GET devices 304 replies",                      httpNotModified);
+
+        WriteHeader(out, "app_http_handler_seconds", "HTTP handler latency", "histogram");
+        for (size_t i = 0; i < httpHandlerLatency.size(); ++i)
+            httpHandlerLatency[i].Write(out, "app_http_handler_seconds", fmt::format("method=\"{}\"", HttpMethodNames[i]));
+
+        WriteCounter(out, "app_mqtt_messages_total",             "MQTT messages",                                mqttMessages);
+        WriteCounter(out, "app_mqtt_parse_errors_total",         "MQTT messages with malformed payload",         mqttParseErrors);
+        WriteCounter(out, "app_mqtt_items_total",                "MQTT device params parsed",                    mqttItems);
+        WriteCounter(out, "app_mqtt_messages_filtered_total",    "MQTT messages of unknown devices by topic",    mqttMessagesFiltered);
+        WriteCounter(out, "app_mqtt_items_filtered_total",       "MQTT device params of unknown devices",        mqttItemsFiltered);
+        WriteCounter(out, "app_mqtt_items_ignored_total",        "MQTT device params without rule or device",    mqttItemsIgnored);
+        WriteCounter(out, "app_mqtt_items_applied_total",        "MQTT device params applied to flags",          mqttItemsApplied);
+        WriteGauge  (out, "app_mqtt_items_pending",              "MQTT device params waiting for processing",    mqttItemsPending);
+        WriteHeader(out, "app_mqtt_message_seconds", "MQTT message processing latency", "histogram");
+        mqttMessageLatency.Write(out, "app_mqtt_message_seconds", "");
+        WriteCounter(out, "app_ingest_batches_total",            "Ingest batches processed",                     ingestBatches);
+        WriteCounter(out, "app_ingest_overflows_total",          "Ingest params pushed to the full queue",       ingestOverflows);
+        WriteCounter(out, "app_ingest_dropped_total",            "Ingest params dropped on overflow",            ingestDropped);
+        WriteCounter(out, "app_ingest_coalesced_total",          "Ingest params coalesced with a queued one",    ingestCoalesced);
+
+        WriteHeader(out, "app_db_seconds", "DB call latency", "histogram");
+        for (size_t i = 0; i < dbLatency.size(); ++i)
+            dbLatency[i].Write(out, "app_db_seconds", fmt::format("method=\"{}\"", DbMethodNames[i]));
+        WriteHeader(out, "app_db_errors_total", "DB call errors", "counter");
+        for (size_t i = 0; i < dbErrors.size(); ++i)
+            out += fmt::format("app_db_errors_total{{method=\"{}\"}} {}\n", DbMethodNames[i], dbErrors[i].load(std::memory_order_relaxed));
+        WriteHeader(out, "app_db_pool_wait_seconds", "DB connection pool wait", "histogram");
+        dbPoolWait.Write(out, "app_db_pool_wait_seconds", "");
+        WriteGauge  (out, "app_db_flags_pending",                "Flags waiting for flush to DB",                dbFlagsPending);
+        WriteGauge  (out, "app_db_async_in_flight",              "DB statements in flight on async connections", dbAsyncInFlight);
+
+        WriteCounter(out, "app_log_dropped_total",               "Log records dropped on full log queue",        logDropped);
+        WriteCounter(out, "app_log_suppressed_total",            "Log records over the rate limit",              logSuppressed);
+        return out;
+    }
+} // namespace app
\ No newline at end of file
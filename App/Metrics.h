@@ -0,0 +1,153 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace app
+{
+    // Lock-free HDR-style histogram of durations: every power of two [2^e, 2^(e+1)) ns is split
+    // into SubCount linear sub-buckets, so a bucket is at most 1/SubCount (25%) wider than its lower bound.
+    // Bucket 0 counts durations below 2^MinBits ns, the last bucket is +Inf.
+    class Histogram
+    {
+    public:
+        static constexpr size_t MinBits     = 8;  // 256 ns
+        static constexpr size_t MaxBits     = 36; // 2^36 ns (~69 s), then +Inf
+        static constexpr size_t SubBits     = 2;
+        static constexpr size_t SubCount    = size_t(1) << SubBits;
+        static constexpr size_t BucketCount = 1 + (MaxBits - MinBits) * SubCount + 1;
+
+        void Record(uint64_t ns)
+        {
+            _buckets[Bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+            _sum.fetch_add(ns, std::memory_order_relaxed);
+        }
+
+        void Record(std::chrono::steady_clock::duration duration)
+        {
+            Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+        }
+
+        // Prometheus histogram in seconds, labels: "name=\"value\"" or empty
+        void Write(std::string& out, const char* name, const std::string& labels) const;
+
+        static size_t Bucket(uint64_t ns)
+        {
+            if (ns < (uint64_t(1) << MinBits))
+                return 0;
+
+            size_t exponent = Log2(ns);
+            if (exponent >= MaxBits)
+                return BucketCount - 1;
+
+            size_t sub = static_cast<size_t>(ns >> (exponent - SubBits)) & (SubCount - 1);
+            return 1 + (exponent - MinBits) * SubCount + sub;
+        }
+
+        // Exclusive upper bound of bucket in ns, bucket < BucketCount - 1
+        static uint64_t UpperBound(size_t bucket)
+        {
+            if (bucket == 0)
+                return uint64_t(1) << MinBits;
+
+            size_t exponent = MinBits + (bucket - 1) / SubCount;
+            size_t sub = (bucket - 1) % SubCount;
+            return (uint64_t(1) << exponent) + ((sub + 1) << (exponent - SubBits));
+        }
+
+    private:
+        static size_t Log2(uint64_t value)
+        {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanReverse64(&index, value);
+            return index;
+#else
+            return 63 - __builtin_clzll(value);
+#endif
+        }
+
+    private:
+        std::array<std::atomic<uint64_t>, BucketCount> _buckets{};
+        std::atomic<uint64_t>                          _sum{ 0 };
+    };
+
+    // Records the time from construction to destruction
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(Histogram& histogram)
+            : _histogram(histogram)
+            , _start(std::chrono::steady_clock::now())
+        {
+        }
+        ~ScopedTimer() { _histogram.Record(std::chrono::steady_clock::now() - _start); }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Histogram&                            _histogram;
+        std::chrono::steady_clock::time_point _start;
+    };
+
+    enum class HttpMethod { Get, Post, Delete, Count };
+    enum class DbMethod   { CreateDevices, ReadDevices, UpdateFlags, DeleteDevices, DeleteAllDevices, PurgeOrphanFlags, Count };
+
+    // Service counters, gauges and latency histograms, exposed in Prometheus text format at GET /metrics.
+    // Updates are relaxed atomics, cheap enough for the ingest hot path.
+    struct Metrics
+    {
+        static Metrics& Instance();
+
+        // HTTP connections reuse
+        std::atomic<uint64_t> httpConnections{ 0 };    // connections served at least one request
+        std::atomic<uint64_t> httpRequests{ 0 };
+        std::atomic<uint64_t> httpReusedRequests{ 0 }; // requests on kept-alive connections
+        std::atomic<uint64_t> httpClosedByLimit{ 0 };  // connections closed by max requests per connection
+
+        // GET devices response cache
+        std::atomic<uint64_t> httpCacheHits{ 0 };
+        std::atomic<uint64_t> httpCacheMisses{ 0 };
+        std::atomic<uint64_t> httpNotModified{ 0 };    // 304 replies on If-None-Match
+
+        std::array<Histogram, static_cast<size_t>(HttpMethod::Count)> httpHandlerLatency;
+
+        // MQTT ingest
+        std::atomic<uint64_t> mqttMessages{ 0 };
+        std::atomic<uint64_t> mqttParseErrors{ 0 };    // messages with malformed payload
+        std::atomic<uint64_t> mqttItems{ 0 };          // parsed device params
+        std::atomic<uint64_t> mqttMessagesFiltered{ 0 }; // topic of an unknown device, not parsed
+        std::atomic<uint64_t> mqttItemsFiltered{ 0 };  // unknown device by the membership filter, not queued
+        std::atomic<uint64_t> mqttItemsIgnored{ 0 };   // no flag rule or unknown device
+        std::atomic<uint64_t> mqttItemsApplied{ 0 };
+        std::atomic<int64_t>  mqttItemsPending{ 0 };   // ingest queue depth
+        Histogram             mqttMessageLatency;      // OnMqttDevMessage
+
+        // Ingest queue
+        std::atomic<uint64_t> ingestBatches{ 0 };
+        std::atomic<uint64_t> ingestOverflows{ 0 };    // pushes to the full queue
+        std::atomic<uint64_t> ingestDropped{ 0 };      // drop_oldest policy, or stopped while blocked
+        std::atomic<uint64_t> ingestCoalesced{ 0 };    // coalesce policy: equal to a queued param
+
+        // DB
+        std::array<Histogram, static_cast<size_t>(DbMethod::Count)>             dbLatency;
+        std::array<std::atomic<uint64_t>, static_cast<size_t>(DbMethod::Count)> dbErrors{};
+        Histogram             dbPoolWait;
+        std::atomic<int64_t>  dbFlagsPending{ 0 };     // queue depth: dirty flags of FlagWriter
+        std::atomic<int64_t>  dbAsyncInFlight{ 0 };    // statements sent on async connections, not completed
+
+        // Logger
+        std::atomic<uint64_t> logDropped{ 0 };         // log ring full
+        std::atomic<uint64_t> logSuppressed{ 0 };      // over the rate limit of a call site
+
+        std::string ToPrometheus() const;
+    };
+} // namespace app
\ No newline at end of file
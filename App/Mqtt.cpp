@@ -2,11 +2,13 @@
 
 #include <functional>
 #include <mosquitto.h>
-#include <regex>
 #include <stdexcept>
 
 #include <fmt/format.h>
-#include <iostream>
+
+#include "DevParamParser.h"
+#include "Logger.h"
+#include "Metrics.h"
 
 namespace app
 {
@@ -17,8 +19,9 @@ namespace app
 
     Mqtt::~Mqtt()
     {
-        mosquitto_loop_stop(_mosq.get(), true);
-        _mosq.reset();
+        for (auto& connection : _connections)
+            mosquitto_loop_stop(connection->mosq.get(), true);
+        _connections.clear();
 
         mosquitto_lib_cleanup();
     }
@@ -28,120 +31,163 @@ namespace app
         _onDevMessage = callback;
     }
 
+    void Mqtt::SetDeviceFilter(const MembershipFilter* filter)
+    {
+        _deviceFilter = filter;
+    }
+
     void Mqtt::Connect(const MqttParams& p)
     {
-        using namespace std::placeholders;
+        if (p.connections == 0)
+            throw std::invalid_argument("MQTT Error: connections must be positive");
+        if (p.connections > 1 && p.share_group.empty())
+            throw std::invalid_argument("MQTT Error: several connections need a share group, otherwise each of them receives every message");
+        if (p.qos < 0 || p.qos > 2)
+            throw std::invalid_argument(fmt::format("MQTT Error: invalid QoS {}", p.qos));
+
+        _topic = p.share_group.empty() ? p.topic : fmt::format("$share/{}/{}", p.share_group, p.topic);
+        _qos   = p.qos;
+        _topicFilter = p.topic_filter;
+
+        for (size_t i = 0; i < p.connections; ++i)
+        {
+            std::unique_ptr<Connection> connection(new Connection);
+            connection->owner = this;
+            connection->index = i;
 
-        _topic = p.topic;
+            connection->mosq = mosquitto_ptr(mosquitto_new(NULL, true, connection.get()), [](mosquitto* ptr) { mosquitto_destroy(ptr); });
+            if (!connection->mosq)
+            {
+                throw std::runtime_error("MQTT Error: mosquitto_new - Out of memory.");
+            }
 
-        _mosq = mosquitto_ptr(mosquitto_new(NULL, true, this), [](mosquitto* ptr) { mosquitto_destroy(ptr); });
-        if (!_mosq)
-        {
-            throw std::runtime_error("MQTT Error: mosquitto_new - Out of memory.");
-        }
+            mosquitto* mosq = connection->mosq.get();
+            if (p.v5)
+                mosquitto_int_option(mosq, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V5);
 
-        mosquitto_connect_callback_set(_mosq.get(), [](mosquitto* mosq, void* obj, int reasonCode)
-        {
-            Mqtt* thisObj = static_cast<Mqtt*>(obj);
-            if (thisObj)
-                thisObj->OnConnect(reasonCode);
-        });
-        mosquitto_subscribe_callback_set(_mosq.get(), [](struct mosquitto *mosq, void *obj, int mid, int qosCount, const int *grantedQos)
-        {
-            Mqtt* thisObj = static_cast<Mqtt*>(obj);
-            if (thisObj)
-                thisObj->OnSubscribe(mid, qosCount, grantedQos);
-        });
-        mosquitto_message_callback_set(_mosq.get(), [](struct mosquitto* mosq, void* obj, const struct mosquitto_message* msg)
-        {
-            Mqtt* thisObj = static_cast<Mqtt*>(obj);
-            if (thisObj)
-                thisObj->OnMessage(msg);
-        });
+            mosquitto_connect_callback_set(mosq, [](mosquitto* mosq, void* obj, int reasonCode)
+            {
+                Connection* connection = static_cast<Connection*>(obj);
+                if (connection)
+                    connection->owner->OnConnect(*connection, reasonCode);
+            });
+            mosquitto_subscribe_callback_set(mosq, [](struct mosquitto *mosq, void *obj, int mid, int qosCount, const int *grantedQos)
+            {
+                Connection* connection = static_cast<Connection*>(obj);
+                if (connection)
+                    connection->owner->OnSubscribe(*connection, mid, qosCount, grantedQos);
+            });
+            mosquitto_message_callback_set(mosq, [](struct mosquitto* mosq, void* obj, const struct mosquitto_message* msg)
+            {
+                Connection* connection = static_cast<Connection*>(obj);
+                if (connection)
+                    connection->owner->OnMessage(*connection, msg);
+            });
 
-        int rc = mosquitto_connect(_mosq.get(), p.host.data(), p.port, p.timeout);
-        if (rc != MOSQ_ERR_SUCCESS) 
-        {
-            _mosq.reset();
-            throw std::runtime_error(fmt::format("MQTT Error: {}", mosquitto_strerror(rc)));
+            int rc = mosquitto_connect(mosq, p.host.data(), p.port, p.timeout);
+            if (rc != MOSQ_ERR_SUCCESS) 
+            {
+                throw std::runtime_error(fmt::format("MQTT Error: {}", mosquitto_strerror(rc)));
+            }
+
+            _connections.push_back(std::move(connection));
         }
     }
 
     void Mqtt::Start()
     {
-        mosquitto_loop_start(_mosq.get());
+        for (auto& connection : _connections)
+            mosquitto_loop_start(connection->mosq.get());
     }
 
-    void Mqtt::OnConnect(int reasonCode)
+    void Mqtt::Stop()
     {
-        std::cerr << fmt::format("MQTT: OnConnect: {}", mosquitto_connack_string(reasonCode)) << std::endl;
+        for (auto& connection : _connections)
+        {
+            mosquitto_disconnect(connection->mosq.get());
+            mosquitto_loop_stop(connection->mosq.get(), false);
+        }
+    }
+
+    void Mqtt::OnConnect(Connection& connection, int reasonCode)
+    {
+        if (reasonCode == 0)
+            LOG_INFO("MQTT: OnConnect", "connection", connection.index, "result", mosquitto_connack_string(reasonCode));
+        else
+            LOG_ERROR("MQTT: OnConnect", "connection", connection.index, "result", mosquitto_connack_string(reasonCode));
         if (reasonCode != 0) 
         {
-            mosquitto_disconnect(_mosq.get());
+            mosquitto_disconnect(connection.mosq.get());
         }
 
-        int rc = mosquitto_subscribe(_mosq.get(), NULL, _topic.data(), 1);
+        int rc = mosquitto_subscribe(connection.mosq.get(), NULL, _topic.data(), _qos);
         if (rc != MOSQ_ERR_SUCCESS) 
         {
-            std::cerr << fmt::format("MQTT Error - subscribing: {}", mosquitto_strerror(rc)) << std::endl;
-            mosquitto_disconnect(_mosq.get());
+            LOG_ERROR("MQTT Error - subscribing", "connection", connection.index, "error", mosquitto_strerror(rc));
+            mosquitto_disconnect(connection.mosq.get());
         }
     }
 
-    void Mqtt::OnSubscribe(int mid, int qosCount, const int* grantedQos)
+    void Mqtt::OnSubscribe(Connection& connection, int mid, int qosCount, const int* grantedQos)
     {
         int i;
         bool have_subscription = false;
 
         for (i = 0; i < qosCount; i++) 
         {
-            std::cout << fmt::format("MQTT: OnSubscribe: {}:granted qos = {}", i, grantedQos[i]) << std::endl;
+            LOG_INFO("MQTT: OnSubscribe", "connection", connection.index, "topic", _topic, "granted_qos", grantedQos[i]);
             if (grantedQos[i] <= 2) {
                 have_subscription = true;
             }
         }
         if (have_subscription == false) 
         {
-            std::cerr << "MQTT Error: All subscriptions rejected." << std::endl;
-            mosquitto_disconnect(_mosq.get());
+            LOG_ERROR("MQTT Error: All subscriptions rejected", "connection", connection.index);
+            mosquitto_disconnect(connection.mosq.get());
         }
     }
 
-    void Mqtt::OnMessage(const mosquitto_message* msg)
+    void Mqtt::OnMessage(Connection& connection, const mosquitto_message* msg)
     {
-        //static std::string delimiter = "/";
-        //std::string devId = msg->topic;
-        //size_t pos = devId.find(delimiter);
-        //if (pos != std::string::npos)
-        //    devId.erase(pos);
-        //std::cout << "\tMQTT topic: device_id: " << devId << std::endl;
-
-        std::string s = (char *)msg->payload;
-
-        // regex for parse dev_eui,param_id,value:
-        //      \{\s*"dev_eui"\s*:\s*"([^"]*)"\s*,\s*"param_id"\s*:\s*([^,\s]*)\s*,\s*"value"\s*:\s*([^,\s]*)\s*\}
-        static std::regex r("\\{\\s*\"dev_eui\"\\s*:\\s*\"([^\"]*)\"\\s*,\\s*\"param_id\"\\s*:\\s*([^,\\s]*)\\s*,\\s*\"value\"\\s*:\\s*([^,\\s]*)\\s*\\}");
+        Metrics& metrics = Metrics::Instance();
+        ++metrics.mqttMessages;
 
-        for (auto it = std::sregex_iterator(s.begin(), s.end(), r); it != std::sregex_iterator(); ++it)
+        // <device id>/out/data: unknown devices are dropped without parsing
+        if (_topicFilter && _deviceFilter && msg->topic)
         {
-            std::smatch m = *it;
-            if (m.size() >= 4)
-            try
-            {  
-                DevParam devParam;
-                devParam.devName          = { m[1].first, m[1].second };
-                std::string strParamId    = { m[2].first, m[2].second };
-                std::string strParamValue = { m[3].first, m[3].second };
-                devParam.paramId = std::stoi(strParamId);
-                devParam.paramValue = std::stoi(strParamValue);
-
-                if (_onDevMessage)
-                    _onDevMessage(std::move(devParam));
+            boost::string_view devId(msg->topic);
+            devId = devId.substr(0, devId.find('/'));
+            if (!_deviceFilter->MayContain(devId))
+            {
+                ++metrics.mqttMessagesFiltered;
+                return;
             }
-            catch (std::exception& ex)
+        }
+
+        DevParamParser parser(static_cast<const char*>(msg->payload), msg->payload ? msg->payloadlen : 0);
+        DevParamParser::Item item;
+        DevMessage& message = connection.message;
+        message.Clear();
+        size_t filtered = 0;
+        while (parser.Next(item))
+        {
+            if (_deviceFilter && !_deviceFilter->MayContain({ item.devName, item.devNameSize }))
             {
-                std::cout << "MQTT Error: parse message: " << ex.what() << std::endl;
+                ++filtered;
+                continue;
             }
+            message.Add(item.devName, item.devNameSize, item.paramId, item.paramValue);
+        }
+
+        metrics.mqttItems += message.Size() + filtered;
+        metrics.mqttItemsFiltered += filtered;
+        if (!message.Empty() && _onDevMessage)
+            _onDevMessage(message);
+
+        if (parser.HasError())
+        {
+            ++metrics.mqttParseErrors;
+            LOG_WARNING("MQTT Error: parse message: invalid JSON", "offset", parser.ErrorOffset());
         }
     }
 
@@ -1,46 +1,103 @@
 ﻿#pragma once
 
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
+
+#include <boost/utility/string_view.hpp>
 
 #include "AppOptions.h"
+#include "MembershipFilter.h"
 
 struct mosquitto;
 struct mosquitto_message;
 
 namespace app
 {
-    struct DevParam
+    // Params of one MQTT message: contiguous compact records, device names are stored
+    // in the message arena. Reused between messages, so steady state doesn't allocate.
+    class DevMessage
     {
-        std::string devName;
-        int         paramId;
-        int         paramValue;
+    public:
+        struct Item
+        {
+            uint32_t devNameOffset;
+            uint32_t devNameSize;
+            int      paramId;
+            int      paramValue;
+        };
+
+        void Clear()
+        {
+            _names.clear();
+            _items.clear();
+        }
+
+        void Add(const char* devName, size_t devNameSize, int paramId, int paramValue)
+        {
+            _items.push_back({ static_cast<uint32_t>(_names.size()), static_cast<uint32_t>(devNameSize), paramId, paramValue });
+            _names.append(devName, devNameSize);
+        }
+
+        boost::string_view DevName(const Item& item) const
+        {
+            return { _names.data() + item.devNameOffset, item.devNameSize };
+        }
+
+        const Item* begin() const { return _items.data(); }
+        const Item* end()   const { return _items.data() + _items.size(); }
+        size_t Size()  const { return _items.size(); }
+        bool   Empty() const { return _items.empty(); }
+
+    private:
+        std::string       _names;
+        std::vector<Item> _items;
     };
 
+    // MQTT consumer: N broker connections, each with its own network thread.
+    // Several connections (and App instances) split messages through a shared subscription.
     class Mqtt
     {
     public:
-        using DevMessageCallback = std::function<void(DevParam devParam)>;
+        // Called once per MQTT message with all its parsed params
+        using DevMessageCallback = std::function<void(const DevMessage& message)>;
 
         Mqtt();
         ~Mqtt();
 
         void SetDevMessageCallback(const DevMessageCallback& callback);
+        void SetDeviceFilter(const MembershipFilter* filter); // Params of rejected devices are dropped before queuing
         void Connect(const MqttParams& p);
         void Start();
+        void Stop();
         
     private:
-        void OnConnect(int reasonCode);
-        void OnSubscribe(int mid, int qosCount, const int *grantedQos);
-        void OnMessage(const struct mosquitto_message* message);
+        using mosquitto_ptr = std::unique_ptr<mosquitto, std::function<void(mosquitto*)>>;
+
+        struct Connection
+        {
+            Mqtt*         owner = nullptr;
+            size_t        index = 0;
+            mosquitto_ptr mosq;
+            DevMessage    message; // of the connection loop thread
+        };
+
+        void OnConnect(Connection& connection, int reasonCode);
+        void OnSubscribe(Connection& connection, int mid, int qosCount, const int *grantedQos);
+        void OnMessage(Connection& connection, const struct mosquitto_message* message);
 
     private:
-        using mosquitto_ptr = std::unique_ptr<mosquitto, std::function<void(mosquitto*)>>;
-        mosquitto_ptr _mosq;
+        std::vector<std::unique_ptr<Connection>> _connections;
 
         DevMessageCallback _onDevMessage;
-        std::string _topic;
+        std::string _topic; // with $share/<group>/ prefix for a shared subscription
+        int         _qos = 1;
+
+        const MembershipFilter* _deviceFilter = nullptr;
+        bool                    _topicFilter = false;
     };
 } // namespace app
\ No newline at end of file
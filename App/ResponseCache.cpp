@@ -0,0 +1,53 @@
+﻿#include "ResponseCache.h"
+
+namespace app
+{
+    ResponseCache::ResponseCache(size_t maxBytes)
+        : _maxBytes(maxBytes)
+    {
+    }
+
+    std::shared_ptr<const std::string> ResponseCache::Get(const std::string& key, uint64_t version)
+    {
+        std::lock_guard<std::mutex> lock(_sync);
+
+        auto it = _entries.find(key);
+        if (it == _entries.end())
+            return nullptr;
+
+        if (it->second.version != version)
+        {
+            Erase(it);
+            return nullptr;
+        }
+
+        _order.splice(_order.begin(), _order, it->second.order);
+        return it->second.body;
+    }
+
+    void ResponseCache::Put(const std::string& key, uint64_t version, std::string body)
+    {
+        if (body.size() > _maxBytes)
+            return;
+
+        std::lock_guard<std::mutex> lock(_sync);
+
+        auto it = _entries.find(key);
+        if (it != _entries.end())
+            Erase(it);
+
+        while (!_order.empty() && _bytes + body.size() > _maxBytes)
+            Erase(_entries.find(_order.back()));
+
+        _bytes += body.size();
+        _order.push_front(key);
+        _entries.emplace(key, Entry{ version, std::make_shared<const std::string>(std::move(body)), _order.begin() });
+    }
+
+    void ResponseCache::Erase(std::unordered_map<std::string, Entry>::iterator it)
+    {
+        _bytes -= it->second.body->size();
+        _order.erase(it->second.order);
+        _entries.erase(it);
+    }
+} // namespace app
\ No newline at end of file
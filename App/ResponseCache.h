@@ -0,0 +1,42 @@
+﻿#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace app
+{
+    // Serialized responses keyed by request, valid for a single DeviceRegistry version.
+    // Least recently used responses are evicted above maxBytes.
+    class ResponseCache
+    {
+    public:
+        explicit ResponseCache(size_t maxBytes);
+
+        // Body cached for key at version, null if missing or outdated
+        std::shared_ptr<const std::string> Get(const std::string& key, uint64_t version);
+        void Put(const std::string& key, uint64_t version, std::string body);
+
+        size_t MaxBytes() const { return _maxBytes; }
+
+    private:
+        struct Entry
+        {
+            uint64_t                               version;
+            std::shared_ptr<const std::string>     body;
+            std::list<std::string>::iterator       order;
+        };
+
+        void Erase(std::unordered_map<std::string, Entry>::iterator it);
+
+    private:
+        const size_t _maxBytes;
+
+        std::mutex                             _sync;
+        std::unordered_map<std::string, Entry> _entries;
+        std::list<std::string>                 _order; // most recently used first
+        size_t                                 _bytes = 0;
+    };
+} // namespace app
\ No newline at end of file
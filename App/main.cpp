@@ -1,4 +1,5 @@
 ﻿#include "App.h"
+#include "Logger.h"
 
 #include <iostream>
 
@@ -10,6 +11,7 @@ int main(int argc, char** argv)
     {
         // Parse program options
         auto options = AppOptions::FromArgs(argc, argv);
+        Logger::Instance().Start(ParseLogLevel(options.App.log_level), options.App.log_queue_size, options.App.log_rate_limit);
 
         // Run app
         App app(std::move(options));
@@ -18,6 +20,7 @@ int main(int argc, char** argv)
     }
     catch (std::exception& ex)
     {
+        Logger::Instance().Stop();
         std::cerr << "Error: " << ex.what() << std::endl;
         return -1;
     }
@@ -0,0 +1,40 @@
+﻿#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Device.h"
+#include "DeviceRegistry.h"
+
+namespace bench
+{
+    // Device with a mix of set and unset flags, as loaded from DB
+    inline app::Device MakeDevice(size_t index)
+    {
+        app::Device device;
+        device.name = "dev" + std::to_string(index);
+        for (size_t i = 0; i < app::FlagCount; ++i)
+        {
+            device.flags[i].value     = (index + i) % 3 != 0;
+            device.flags[i].timestamp = 1700000000 + index % 1000;
+        }
+        return device;
+    }
+
+    inline std::vector<app::Device> MakeDevices(size_t count)
+    {
+        std::vector<app::Device> devices;
+        devices.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            devices.push_back(MakeDevice(i));
+        return devices;
+    }
+
+    inline void FillRegistry(app::DeviceRegistry& registry, size_t count)
+    {
+        registry.Reset(MakeDevices(count));
+    }
+
+    constexpr uint64_t Timestamp = 1700001000;
+    constexpr size_t   Threshold = 259200;
+} // namespace bench
\ No newline at end of file
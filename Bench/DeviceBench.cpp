@@ -0,0 +1,67 @@
+﻿#include <benchmark/benchmark.h>
+
+#include "BenchData.h"
+#include "Device.h"
+#include "FlagRules.h"
+
+using namespace app;
+
+namespace
+{
+    void BM_Device_ToJson(benchmark::State& state)
+    {
+        Device device = bench::MakeDevice(42);
+        for (auto _ : state)
+        {
+            json j = device;
+            benchmark::DoNotOptimize(j);
+        }
+    }
+    BENCHMARK(BM_Device_ToJson);
+
+    void BM_Device_FromJson(benchmark::State& state)
+    {
+        json j = bench::MakeDevice(42);
+        for (auto _ : state)
+        {
+            Device device = j.get<Device>();
+            benchmark::DoNotOptimize(device);
+        }
+    }
+    BENCHMARK(BM_Device_FromJson);
+
+    void BM_Device_CalcDynamicFlags(benchmark::State& state)
+    {
+        Device device = bench::MakeDevice(42);
+        device.CalcChangeTimestamps(bench::Timestamp);
+        for (auto _ : state)
+        {
+            device.CalcDynamicFlags(bench::Threshold);
+            benchmark::DoNotOptimize(device.acceptanceResult);
+        }
+    }
+    BENCHMARK(BM_Device_CalcDynamicFlags);
+
+    void BM_Device_CalcChangeTimestamps(benchmark::State& state)
+    {
+        Device device = bench::MakeDevice(42);
+        for (auto _ : state)
+        {
+            device.CalcChangeTimestamps(bench::Timestamp);
+            benchmark::DoNotOptimize(device.flags);
+        }
+    }
+    BENCHMARK(BM_Device_CalcChangeTimestamps);
+
+    void BM_FlagRules_Match(benchmark::State& state)
+    {
+        FlagRules rules = FlagRules::Default();
+        int param = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(rules.Match(param % 4, param % 16));
+            ++param;
+        }
+    }
+    BENCHMARK(BM_FlagRules_Match);
+} // namespace
\ No newline at end of file
@@ -0,0 +1,60 @@
+﻿#include <string>
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+
+#include "DevParamParser.h"
+#include "Mqtt.h"
+
+using namespace app;
+
+namespace
+{
+    // Payload of +/out/data with items params of different devices
+    std::string MakePayload(size_t items)
+    {
+        std::string payload = "[";
+        for (size_t i = 0; i < items; ++i)
+        {
+            if (i != 0)
+                payload += ',';
+            payload += fmt::format("{{\"dev_eui\":\"dev{}\",\"param_id\":{},\"value\":{}}}", i * 7919 % 100000, 1 + i % 2, i % 20);
+        }
+        payload += ']';
+        return payload;
+    }
+
+    void BM_DevParamParser(benchmark::State& state)
+    {
+        std::string payload = MakePayload(static_cast<size_t>(state.range(0)));
+        for (auto _ : state)
+        {
+            DevParamParser parser(payload.data(), payload.size());
+            DevParamParser::Item item;
+            while (parser.Next(item))
+                benchmark::DoNotOptimize(item);
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(payload.size()));
+    }
+    BENCHMARK(BM_DevParamParser)->Arg(1)->Arg(10)->Arg(100);
+
+    // As Mqtt::OnMessage: items are collected into the reused DevMessage for the callback
+    void BM_DevParamParser_DevMessage(benchmark::State& state)
+    {
+        std::string payload = MakePayload(static_cast<size_t>(state.range(0)));
+        DevMessage message;
+        for (auto _ : state)
+        {
+            DevParamParser parser(payload.data(), payload.size());
+            DevParamParser::Item item;
+            message.Clear();
+            while (parser.Next(item))
+                message.Add(item.devName, item.devNameSize, item.paramId, item.paramValue);
+            benchmark::DoNotOptimize(message.Size());
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(payload.size()));
+    }
+    BENCHMARK(BM_DevParamParser_DevMessage)->Arg(1)->Arg(10)->Arg(100);
+} // namespace
\ No newline at end of file
@@ -0,0 +1,93 @@
+﻿#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "BenchData.h"
+#include "DeviceRegistry.h"
+
+using namespace app;
+
+namespace
+{
+    constexpr size_t DeviceCount = 100000;
+
+    std::vector<std::string> MakeNames(size_t count, const char* prefix)
+    {
+        std::vector<std::string> names;
+        for (size_t i = 0; i < count; ++i)
+            names.push_back(prefix + std::to_string(i * 7919 % DeviceCount));
+        return names;
+    }
+
+    // Devices known (hit) or unknown (miss) to registry, as MQTT params of other devices
+    void BM_Registry_Contains(benchmark::State& state)
+    {
+        DeviceRegistry registry;
+        bench::FillRegistry(registry, DeviceCount);
+        auto names = MakeNames(1024, state.range(0) ? "dev" : "other");
+
+        size_t i = 0;
+        for (auto _ : state)
+            benchmark::DoNotOptimize(registry.Contains(names[i++ % names.size()]));
+    }
+    BENCHMARK(BM_Registry_Contains)->ArgName("hit")->Arg(1)->Arg(0);
+
+    // Lock-free pre-check of Mqtt before queuing params
+    void BM_Registry_FilterMayContain(benchmark::State& state)
+    {
+        DeviceRegistry registry;
+        bench::FillRegistry(registry, DeviceCount);
+        auto names = MakeNames(1024, state.range(0) ? "dev" : "other");
+
+        size_t i = 0;
+        for (auto _ : state)
+            benchmark::DoNotOptimize(registry.Filter().MayContain(names[i++ % names.size()]));
+    }
+    BENCHMARK(BM_Registry_FilterMayContain)->ArgName("hit")->Arg(1)->Arg(0);
+
+    // Flag update of OnMqttDevMessage
+    void BM_Registry_Update(benchmark::State& state)
+    {
+        DeviceRegistry registry;
+        bench::FillRegistry(registry, DeviceCount);
+        auto names = MakeNames(1024, "dev");
+
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            registry.Update(names[i++ % names.size()], [](Device& device)
+            {
+                device.flags[0].value = true;
+                device.flags[0].timestamp = bench::Timestamp;
+            });
+        }
+    }
+    BENCHMARK(BM_Registry_Update)->ThreadRange(1, 8);
+
+    void BM_Registry_Get(benchmark::State& state)
+    {
+        DeviceRegistry registry;
+        bench::FillRegistry(registry, DeviceCount);
+        auto names = MakeNames(1024, "dev");
+
+        size_t i = 0;
+        Device device;
+        for (auto _ : state)
+            benchmark::DoNotOptimize(registry.Get(names[i++ % names.size()], device));
+    }
+    BENCHMARK(BM_Registry_Get);
+
+    void BM_Registry_GetPage(benchmark::State& state)
+    {
+        DeviceRegistry registry;
+        bench::FillRegistry(registry, DeviceCount);
+        const std::string after = "dev5";
+        size_t limit = static_cast<size_t>(state.range(0));
+
+        for (auto _ : state)
+            benchmark::DoNotOptimize(registry.GetPage(&after, "", limit));
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(BM_Registry_GetPage)->Arg(256)->Arg(4096);
+} // namespace
\ No newline at end of file
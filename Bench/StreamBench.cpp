@@ -0,0 +1,68 @@
+﻿#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "BenchData.h"
+#include "DeviceQuery.h"
+#include "DeviceRegistry.h"
+#include "DevicesStream.h"
+#include "Encoding.h"
+
+using namespace app;
+
+namespace
+{
+    // Serialization of GET /devices: chunked stream of all devices
+    void StreamDevices(benchmark::State& state, Encoding encoding, int indent)
+    {
+        DeviceRegistry registry;
+        bench::FillRegistry(registry, static_cast<size_t>(state.range(0)));
+
+        size_t bytes = 0;
+        std::string chunk;
+        for (auto _ : state)
+        {
+            DevicesStream stream(registry, DeviceQuery(), bench::Timestamp, bench::Threshold, encoding, indent);
+            while (stream.NextChunk(chunk))
+            {
+                bytes += chunk.size();
+                benchmark::DoNotOptimize(chunk.data());
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+        state.SetBytesProcessed(static_cast<int64_t>(bytes));
+    }
+
+    void BM_GetDevices_Json(benchmark::State& state)       { StreamDevices(state, Encoding::Json, -1); }
+    void BM_GetDevices_JsonPretty(benchmark::State& state) { StreamDevices(state, Encoding::Json, 4); }
+    void BM_GetDevices_Cbor(benchmark::State& state)       { StreamDevices(state, Encoding::Cbor, -1); }
+    BENCHMARK(BM_GetDevices_Json)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+    BENCHMARK(BM_GetDevices_JsonPretty)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+    BENCHMARK(BM_GetDevices_Cbor)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+    // MessagePack is serialized as a whole document
+    void BM_GetDevices_MsgPack(benchmark::State& state)
+    {
+        DeviceRegistry registry;
+        bench::FillRegistry(registry, static_cast<size_t>(state.range(0)));
+
+        size_t bytes = 0;
+        for (auto _ : state)
+        {
+            DeviceCursor cursor(registry, DeviceQuery(), bench::Timestamp, bench::Threshold);
+            std::vector<Device> devices;
+            Device device;
+            while (cursor.Next(device))
+                devices.push_back(std::move(device));
+
+            json jsonData{ {"devices",devices}, };
+            std::string body = Serialize(jsonData, Encoding::MsgPack);
+            bytes += body.size();
+            benchmark::DoNotOptimize(body.data());
+        }
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+        state.SetBytesProcessed(static_cast<int64_t>(bytes));
+    }
+    BENCHMARK(BM_GetDevices_MsgPack)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+} // namespace
\ No newline at end of file
@@ -0,0 +1,3 @@
+﻿#include <benchmark/benchmark.h>
+
+BENCHMARK_MAIN();
\ No newline at end of file
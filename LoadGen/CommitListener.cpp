@@ -0,0 +1,115 @@
+﻿#include "CommitListener.h"
+
+#include <iostream>
+#include <stdexcept>
+
+#include <fmt/format.h>
+#include <libpq-fe.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#define poll WSAPoll
+#else
+#include <poll.h>
+#endif
+
+namespace loadgen
+{
+    namespace
+    {
+        const char* Channel = "loadgen_flags";
+    }
+
+    CommitListener::CommitListener(Callback callback)
+        : _callback(std::move(callback))
+    {
+    }
+
+    CommitListener::~CommitListener()
+    {
+        Stop();
+    }
+
+    void CommitListener::Start(const LoadGenOptions& p, const std::string& devicePrefix)
+    {
+        std::string connection = fmt::format("dbname={} user={} password={} host={} port={}",
+            p.db_name, p.db_user, p.db_password, p.db_host, p.db_port);
+        _conn = PQconnectdb(connection.data());
+        if (PQstatus(_conn) != CONNECTION_OK)
+        {
+            std::string error = PQerrorMessage(_conn);
+            PQfinish(_conn);
+            _conn = nullptr;
+            throw std::runtime_error("DB connect: " + error);
+        }
+
+        Exec(fmt::format(
+            "CREATE OR REPLACE FUNCTION loadgen_notify_flag() RETURNS trigger AS $$ "
+            "DECLARE name text; "
+            "BEGIN "
+            "    SELECT device_name INTO name FROM devices WHERE device_id = NEW.device_id; "
+            "    IF name LIKE '{0}%' THEN "
+            "        PERFORM pg_notify('{1}', name || '/' || NEW.flag_name); "
+            "    END IF; "
+            "    RETURN NEW; "
+            "END $$ LANGUAGE plpgsql", devicePrefix, Channel));
+        Exec("DROP TRIGGER IF EXISTS loadgen_notify_flag ON flags");
+        Exec("CREATE TRIGGER loadgen_notify_flag AFTER INSERT OR UPDATE ON flags "
+             "FOR EACH ROW EXECUTE FUNCTION loadgen_notify_flag()");
+        Exec(fmt::format("LISTEN {}", Channel));
+
+        _stop = false;
+        _thread = std::thread(&CommitListener::Run, this);
+    }
+
+    void CommitListener::Stop()
+    {
+        _stop = true;
+        if (_thread.joinable())
+            _thread.join();
+
+        if (!_conn)
+            return;
+
+        Exec("DROP TRIGGER IF EXISTS loadgen_notify_flag ON flags");
+        Exec("DROP FUNCTION IF EXISTS loadgen_notify_flag()");
+        PQfinish(_conn);
+        _conn = nullptr;
+    }
+
+    void CommitListener::Run()
+    {
+        // poll, not select: the socket can be above FD_SETSIZE
+        pollfd pfd{};
+        pfd.fd     = PQsocket(_conn);
+        pfd.events = POLLIN;
+        while (!_stop)
+        {
+            if (poll(&pfd, 1, 100) <= 0)
+                continue;
+
+            if (!PQconsumeInput(_conn))
+            {
+                std::cerr << "DB: LISTEN: " << PQerrorMessage(_conn) << std::endl;
+                return;
+            }
+
+            while (PGnotify* notify = PQnotifies(_conn))
+            {
+                _callback(notify->extra);
+                PQfreemem(notify);
+            }
+        }
+    }
+
+    void CommitListener::Exec(const std::string& sql)
+    {
+        PGresult* result = PQexec(_conn, sql.data());
+        ExecStatusType status = PQresultStatus(result);
+        std::string error = PQresultErrorMessage(result);
+        PQclear(result);
+
+        if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK)
+            throw std::runtime_error(fmt::format("DB: {}: {}", sql, error));
+    }
+} // namespace loadgen
\ No newline at end of file
@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "LoadGenOptions.h"
+
+struct pg_conn;
+
+namespace loadgen
+{
+    // Observes commits of flags: a temporary trigger on the flags table sends NOTIFY per written flag,
+    // notifications are delivered on commit. Payload: "<device name>/<flag name>".
+    class CommitListener
+    {
+    public:
+        using Callback = std::function<void(const std::string& payload)>;
+
+        explicit CommitListener(Callback callback);
+        ~CommitListener();
+
+        // Installs the trigger for devices with names starting with devicePrefix and starts listening
+        void Start(const LoadGenOptions& p, const std::string& devicePrefix);
+        void Stop(); // Removes the trigger
+
+    private:
+        void Run();
+        void Exec(const std::string& sql);
+
+    private:
+        Callback          _callback;
+        pg_conn*          _conn = nullptr;
+        std::atomic<bool> _stop{ false };
+        std::thread       _thread;
+    };
+} // namespace loadgen
\ No newline at end of file
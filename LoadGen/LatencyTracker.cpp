@@ -0,0 +1,60 @@
+﻿#include "LatencyTracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace loadgen
+{
+    void LatencyTracker::Published(const std::string& key, Clock::time_point time)
+    {
+        std::lock_guard<std::mutex> lock(_sync);
+        _pending.emplace(key, time); // keeps the oldest
+    }
+
+    void LatencyTracker::Committed(const std::string& key, Clock::time_point time)
+    {
+        std::lock_guard<std::mutex> lock(_sync);
+
+        auto it = _pending.find(key);
+        if (it == _pending.end())
+            return; // Flag of another client or committed again
+
+        _latencies.push_back(std::chrono::duration<double, std::milli>(time - it->second).count());
+        _pending.erase(it);
+        _lastCommit = time;
+    }
+
+    size_t LatencyTracker::Pending() const
+    {
+        std::lock_guard<std::mutex> lock(_sync);
+        return _pending.size();
+    }
+
+    LatencyTracker::Report LatencyTracker::GetReport() const
+    {
+        std::vector<double> latencies;
+        Report report;
+        {
+            std::lock_guard<std::mutex> lock(_sync);
+            latencies = _latencies;
+            report.pending = _pending.size();
+            report.lastCommit = _lastCommit;
+        }
+
+        report.committed = latencies.size();
+        if (latencies.empty())
+            return report;
+
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies](double p)
+        {
+            size_t rank = static_cast<size_t>(std::ceil(p * latencies.size()));
+            return latencies[std::min(std::max<size_t>(rank, 1), latencies.size()) - 1];
+        };
+        report.p50  = percentile(0.5);
+        report.p99  = percentile(0.99);
+        report.p999 = percentile(0.999);
+        report.max  = latencies.back();
+        return report;
+    }
+} // namespace loadgen
\ No newline at end of file
@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace loadgen
+{
+    // Matches publishes of device flags with their DB commits.
+    // App coalesces updates of a flag until flush, so a commit completes the oldest pending publish of the flag.
+    class LatencyTracker
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Report
+        {
+            size_t committed = 0;
+            size_t pending = 0;   // published, not committed
+            double p50 = 0;       // ms
+            double p99 = 0;
+            double p999 = 0;
+            double max = 0;
+            Clock::time_point lastCommit;
+        };
+
+        void Published(const std::string& key, Clock::time_point time);
+        void Committed(const std::string& key, Clock::time_point time);
+
+        size_t Pending() const;
+        Report GetReport() const;
+
+    private:
+        mutable std::mutex                             _sync;
+        std::unordered_map<std::string, Clock::time_point> _pending; // oldest publish of key
+        std::vector<double>                            _latencies;   // ms
+        Clock::time_point                              _lastCommit;
+    };
+} // namespace loadgen
\ No newline at end of file
@@ -0,0 +1,73 @@
+﻿#include "LoadGenOptions.h"
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+namespace loadgen
+{
+    LoadGenOptions LoadGenOptions::FromArgs(int argc, char** argv)
+    {
+        // Defaults target docker-compose.yml
+        po::options_description desc("Options");
+        desc.add_options()
+            //
+            ("devices",     po::value<size_t>()->default_value(1000),         "Known devices")
+            ("rate",        po::value<size_t>()->default_value(1000),         "Messages per second")
+            ("items",       po::value<size_t>()->default_value(10),           "Device params per message")
+            ("miss_ratio",  po::value<double>()->default_value(0.1),          "Share of params of unknown devices, 0..1")
+            ("duration",    po::value<size_t>()->default_value(30),           "Publishing duration, s")
+            ("drain",       po::value<size_t>()->default_value(10),           "Waiting for commits after publishing, s")
+            ("seed",        po::value<uint32_t>()->default_value(1),          "Random seed")
+            ("cleanup",     po::value<bool>()->default_value(true),           "Delete devices after the run")
+            //
+            ("app_host",    po::value<std::string>()->default_value("127.0.0.1"), "App REST host")
+            ("app_port",    po::value<uint16_t>()->default_value(54545),      "App REST port")
+            //
+            ("mqtt_host",   po::value<std::string>()->default_value("127.0.0.1"), "MQTT host")
+            ("mqtt_port",   po::value<uint16_t>()->default_value(1884),       "MQTT port")
+            ("mqtt_topic",  po::value<std::string>()->default_value("loadgen/out/data"), "MQTT topic")
+            ("mqtt_qos",    po::value<int>()->default_value(0),               "MQTT QoS")
+            //
+            ("db_name",     po::value<std::string>()->default_value("app_postgres"), "DataBase name")
+            ("db_user",     po::value<std::string>()->default_value("app_user"),     "DataBase user")
+            ("db_password", po::value<std::string>()->default_value("app_password"), "DataBase password")
+            ("db_host",     po::value<std::string>()->default_value("127.0.0.1"),    "DataBase host IP")
+            ("db_port",     po::value<uint16_t>()->default_value(5433),              "DataBase port")
+            ;
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+
+        LoadGenOptions options;
+        options.devices     = vm["devices"].as<size_t>();
+        options.rate        = vm["rate"].as<size_t>();
+        options.items       = vm["items"].as<size_t>();
+        options.miss_ratio  = vm["miss_ratio"].as<double>();
+        options.duration    = vm["duration"].as<size_t>();
+        options.drain       = vm["drain"].as<size_t>();
+        options.seed        = vm["seed"].as<uint32_t>();
+        options.cleanup     = vm["cleanup"].as<bool>();
+
+        options.app_host    = vm["app_host"].as<std::string>();
+        options.app_port    = vm["app_port"].as<uint16_t>();
+
+        options.mqtt_host   = vm["mqtt_host"].as<std::string>();
+        options.mqtt_port   = vm["mqtt_port"].as<uint16_t>();
+        options.mqtt_topic  = vm["mqtt_topic"].as<std::string>();
+        options.mqtt_qos    = vm["mqtt_qos"].as<int>();
+
+        options.db_name     = vm["db_name"].as<std::string>();
+        options.db_user     = vm["db_user"].as<std::string>();
+        options.db_password = vm["db_password"].as<std::string>();
+        options.db_host     = vm["db_host"].as<std::string>();
+        options.db_port     = vm["db_port"].as<uint16_t>();
+
+        if (options.rate == 0 || options.items == 0 || options.devices == 0)
+            throw std::invalid_argument("devices, rate and items must be positive");
+        if (options.miss_ratio < 0 || options.miss_ratio > 1)
+            throw std::invalid_argument("miss_ratio must be in 0..1");
+        return options;
+    }
+} // namespace loadgen
\ No newline at end of file
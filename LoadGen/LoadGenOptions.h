@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include <string>
+
+namespace loadgen
+{
+    struct LoadGenOptions
+    {
+        // Load
+        size_t      devices;     // known devices, created in App before the run
+        size_t      rate;        // messages per second
+        size_t      items;       // device params per message
+        double      miss_ratio;  // share of params of devices unknown to App
+        size_t      duration;    // s
+        size_t      drain;       // s, waiting for the last commits after publishing
+        uint32_t    seed;
+        bool        cleanup;     // delete devices after the run
+
+        // App REST
+        std::string app_host;
+        uint16_t    app_port;
+
+        // MQTT
+        std::string mqtt_host;
+        uint16_t    mqtt_port;
+        std::string mqtt_topic;
+        int         mqtt_qos;
+
+        // DB: commits are observed by LISTEN/NOTIFY
+        std::string db_name;
+        std::string db_user;
+        std::string db_password;
+        std::string db_host;
+        uint16_t    db_port;
+
+        static LoadGenOptions FromArgs(int argc, char** argv);
+    };
+} // namespace loadgen
\ No newline at end of file
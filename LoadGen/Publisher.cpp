@@ -0,0 +1,57 @@
+﻿#include "Publisher.h"
+
+#include <mosquitto.h>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+namespace loadgen
+{
+    Publisher::Publisher()
+    {
+        mosquitto_lib_init();
+    }
+
+    Publisher::~Publisher()
+    {
+        Disconnect();
+        mosquitto_lib_cleanup();
+    }
+
+    void Publisher::Connect(const std::string& host, uint16_t port)
+    {
+        _mosq = mosquitto_ptr(mosquitto_new(NULL, true, this), [](mosquitto* ptr) { mosquitto_destroy(ptr); });
+        if (!_mosq)
+            throw std::runtime_error("MQTT Error: mosquitto_new - Out of memory.");
+
+        // Unlimited queue, the publish rate is controlled by the caller
+        mosquitto_max_inflight_messages_set(_mosq.get(), 0);
+
+        int rc = mosquitto_connect(_mosq.get(), host.data(), port, 60);
+        if (rc != MOSQ_ERR_SUCCESS)
+        {
+            _mosq.reset();
+            throw std::runtime_error(fmt::format("MQTT Error: {}", mosquitto_strerror(rc)));
+        }
+
+        rc = mosquitto_loop_start(_mosq.get());
+        if (rc != MOSQ_ERR_SUCCESS)
+            throw std::runtime_error(fmt::format("MQTT Error: {}", mosquitto_strerror(rc)));
+    }
+
+    void Publisher::Disconnect()
+    {
+        if (!_mosq)
+            return;
+
+        mosquitto_disconnect(_mosq.get());
+        mosquitto_loop_stop(_mosq.get(), false);
+        _mosq.reset();
+    }
+
+    bool Publisher::Publish(const std::string& topic, const std::string& payload, int qos)
+    {
+        int rc = mosquitto_publish(_mosq.get(), NULL, topic.data(), static_cast<int>(payload.size()), payload.data(), qos, false);
+        return rc == MOSQ_ERR_SUCCESS;
+    }
+} // namespace loadgen
\ No newline at end of file
@@ -0,0 +1,27 @@
+﻿#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+struct mosquitto;
+
+namespace loadgen
+{
+    class Publisher
+    {
+    public:
+        Publisher();
+        ~Publisher();
+
+        void Connect(const std::string& host, uint16_t port);
+        void Disconnect();
+
+        // Returns false if the message wasn't queued
+        bool Publish(const std::string& topic, const std::string& payload, int qos);
+
+    private:
+        using mosquitto_ptr = std::unique_ptr<mosquitto, std::function<void(mosquitto*)>>;
+        mosquitto_ptr _mosq;
+    };
+} // namespace loadgen
\ No newline at end of file
@@ -0,0 +1,163 @@
+﻿#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+#include <restbed>
+
+#include "CommitListener.h"
+#include "LatencyTracker.h"
+#include "LoadGenOptions.h"
+#include "Publisher.h"
+
+using json = nlohmann::json;
+
+namespace loadgen
+{
+    namespace
+    {
+        const std::string KnownPrefix   = "loadgen_dev";  // created in App
+        const std::string UnknownPrefix = "loadgen_miss"; // never created
+
+        // Params of App built-in flag rules
+        struct FlagParam
+        {
+            const char* flagName;
+            int         paramId;
+            int         paramValue;
+        };
+        const FlagParam FlagParams[] = {
+            { "flag1", 1, 0  },
+            { "flag2", 1, 1  },
+            { "flag3", 2, 12 },
+        };
+
+        void SendDevices(const LoadGenOptions& p, const std::string& method, const std::vector<std::string>& names)
+        {
+            std::string body = json{ {"devicesIds", names} }.dump();
+
+            auto request = std::make_shared<restbed::Request>(restbed::Uri(fmt::format("http://{}:{}/devices", p.app_host, p.app_port)));
+            request->set_method(method);
+            request->set_header("Accept",         "application/json");
+            request->set_header("Content-Type",   "application/json");
+            request->set_header("Content-Length", std::to_string(body.size()));
+            request->set_body(body);
+
+            auto response = restbed::Http::sync(request);
+            if (response->get_status_code() != restbed::OK)
+                throw std::runtime_error(fmt::format("App: {} /devices: HTTP {}", method, response->get_status_code()));
+        }
+
+        int Run(const LoadGenOptions& p)
+        {
+            using Clock = LatencyTracker::Clock;
+            using namespace std::chrono;
+
+            LatencyTracker tracker;
+            CommitListener listener([&tracker](const std::string& key) { tracker.Committed(key, Clock::now()); });
+            listener.Start(p, KnownPrefix);
+
+            std::vector<std::string> devices;
+            for (size_t i = 0; i < p.devices; ++i)
+                devices.push_back(KnownPrefix + std::to_string(i));
+            SendDevices(p, "POST", devices);
+            std::cout << fmt::format("Devices: {} created", devices.size()) << std::endl;
+
+            Publisher publisher;
+            publisher.Connect(p.mqtt_host, p.mqtt_port);
+
+            std::mt19937 random(p.seed);
+            std::uniform_int_distribution<size_t> deviceDist(0, p.devices - 1);
+            std::uniform_int_distribution<size_t> flagDist(0, sizeof(FlagParams) / sizeof(FlagParams[0]) - 1);
+            std::bernoulli_distribution           missDist(p.miss_ratio);
+
+            std::cout << fmt::format("Load: {} messages/s x {} params, miss ratio {}, {} s, topic {}",
+                p.rate, p.items, p.miss_ratio, p.duration, p.mqtt_topic) << std::endl;
+
+            const auto interval = duration_cast<Clock::duration>(duration<double>(1.0 / p.rate));
+            const auto start = Clock::now();
+            const auto end = start + seconds(p.duration);
+
+            size_t messages = 0;
+            size_t failed = 0;
+            size_t knownItems = 0;
+            std::vector<std::string> keys;
+            for (auto next = start; next < end; next += interval)
+            {
+                std::this_thread::sleep_until(next);
+
+                std::string payload = "[";
+                keys.clear();
+                for (size_t i = 0; i < p.items; ++i)
+                {
+                    bool miss = missDist(random);
+                    std::string name = (miss ? UnknownPrefix : KnownPrefix) + std::to_string(deviceDist(random));
+                    const FlagParam& param = FlagParams[flagDist(random)];
+
+                    if (i != 0)
+                        payload += ',';
+                    payload += fmt::format("{{\"dev_eui\":\"{}\",\"param_id\":{},\"value\":{}}}", name, param.paramId, param.paramValue);
+                    if (!miss)
+                        keys.push_back(name + '/' + param.flagName);
+                }
+                payload += ']';
+
+                auto now = Clock::now();
+                if (!publisher.Publish(p.mqtt_topic, payload, p.mqtt_qos))
+                {
+                    ++failed;
+                    continue;
+                }
+
+                for (const auto& key : keys)
+                    tracker.Published(key, now);
+                ++messages;
+                knownItems += keys.size();
+            }
+            const auto published = Clock::now();
+            size_t pendingAtEnd = tracker.Pending();
+
+            // Last updates are written by the next App flush
+            const auto drainEnd = published + seconds(p.drain);
+            while (tracker.Pending() != 0 && Clock::now() < drainEnd)
+                std::this_thread::sleep_for(milliseconds(100));
+
+            publisher.Disconnect();
+            listener.Stop();
+            if (p.cleanup)
+                SendDevices(p, "DELETE", devices);
+
+            auto report = tracker.GetReport();
+            double publishSeconds = duration<double>(published - start).count();
+            double commitSeconds = duration<double>(std::max(report.lastCommit, published) - start).count();
+
+            std::cout << fmt::format("Published: {} messages ({} failed), {} params ({} of known devices) in {:.1f} s: {:.0f} messages/s, {:.0f} params/s",
+                messages, failed, messages * p.items, knownItems, publishSeconds, messages / publishSeconds, messages * p.items / publishSeconds) << std::endl;
+            std::cout << fmt::format("Committed: {} flags in {:.1f} s: {:.0f} flags/s (updates of a flag between App flushes are coalesced)",
+                report.committed, commitSeconds, report.committed / commitSeconds) << std::endl;
+            std::cout << fmt::format("Not committed: {} at the end of publishing, {} after {} s drain",
+                pendingAtEnd, report.pending, p.drain) << std::endl;
+            std::cout << fmt::format("Latency publish -> DB commit, ms: p50={:.1f} p99={:.1f} p999={:.1f} max={:.1f}",
+                report.p50, report.p99, report.p999, report.max) << std::endl;
+            return report.pending == 0 ? 0 : 1;
+        }
+    } // namespace
+} // namespace loadgen
+
+int main(int argc, char** argv)
+{
+    using namespace loadgen;
+
+    try
+    {
+        auto options = LoadGenOptions::FromArgs(argc, argv);
+        return Run(options);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return -1;
+    }
+}
\ No newline at end of file
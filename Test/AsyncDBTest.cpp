@@ -0,0 +1,387 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "AsyncDB.h"
+
+// The fake server uses POSIX sockets
+#if !defined(_WIN32)
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace app;
+
+namespace
+{
+    // Minimal Postgres server over the v3 protocol, enough for AsyncDB: trust authentication,
+    // prepared statements and pipelines of Bind/Describe/Execute/Sync. A statement whose first
+    // parameter contains "fail" gets an ErrorResponse, the rest of its pipeline up to Sync is skipped.
+    // With eagerReplies the whole reply of a statement, up to ReadyForQuery, is sent as soon as its Bind
+    // starts and the Bind body is read later: the client still flushing the statement reads the reply.
+    class FakePgServer
+    {
+    public:
+        explicit FakePgServer(bool eagerReplies = false)
+            : _eagerReplies(eagerReplies)
+        {
+            _listen = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = 0;
+            bind(_listen, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            listen(_listen, 4);
+
+            socklen_t size = sizeof(addr);
+            getsockname(_listen, reinterpret_cast<sockaddr*>(&addr), &size);
+            _port = ntohs(addr.sin_port);
+
+            _thread = std::thread(&FakePgServer::Run, this);
+        }
+
+        ~FakePgServer()
+        {
+            shutdown(_listen, SHUT_RDWR);
+            close(_listen);
+            _thread.join();
+        }
+
+        uint16_t Port() const { return _port; }
+        size_t Executed() const { return _executed; }
+        size_t Syncs() const { return _syncs; }
+
+    private:
+        void Run()
+        {
+            int client = accept(_listen, nullptr, nullptr);
+            if (client < 0)
+                return;
+
+            // Replies are small messages, as Postgres does
+            int noDelay = 1;
+            setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            Serve(client);
+            close(client);
+        }
+
+        void Serve(int client)
+        {
+            // SSL and GSS encryption requests are declined, then the startup message
+            for (;;)
+            {
+                std::string body;
+                if (!ReadExact(client, body, 4))
+                    return;
+                uint32_t length = ReadInt32(body.data());
+                if (!ReadExact(client, body, length - 4))
+                    return;
+                uint32_t code = ReadInt32(body.data());
+                if (code == 80877103 || code == 80877104)
+                {
+                    Send(client, "N");
+                    continue;
+                }
+                break;
+            }
+
+            std::string out;
+            AppendMessage(out, 'R', std::string(4, '\0')); // AuthenticationOk
+            AppendMessage(out, 'Z', "I");
+            Send(client, out);
+
+            bool failed = false;
+            bool replied = false; // eager reply of the current statement is sent
+            for (;;)
+            {
+                std::string header;
+                if (!ReadExact(client, header, 5))
+                    return;
+                char type = header[0];
+
+                if (_eagerReplies && type == 'B')
+                {
+                    out.clear();
+                    AppendMessage(out, '2', "");
+                    AppendMessage(out, 'n', "");
+                    AppendMessage(out, 'C', std::string("INSERT 0 1\0", 11));
+                    AppendMessage(out, 'Z', "I");
+                    if (!Send(client, out))
+                        return;
+                    replied = true;
+                    ++_executed;
+                    ++_syncs;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+
+                std::string body;
+                if (!ReadExact(client, body, ReadInt32(header.data() + 1) - 4))
+                    return;
+
+                if (replied)
+                {
+                    replied = type != 'S';
+                    continue;
+                }
+
+                out.clear();
+                switch (type)
+                {
+                case 'P': // Parse
+                    if (!failed)
+                        AppendMessage(out, '1', "");
+                    break;
+                case 'B': // Bind
+                    if (failed)
+                        break;
+                    if (FirstParam(body).find("fail") != std::string::npos)
+                    {
+                        failed = true;
+                        AppendMessage(out, 'E', std::string("SERROR\0VERROR\0C23505\0Mfake failure\0\0", 38));
+                        break;
+                    }
+                    AppendMessage(out, '2', "");
+                    break;
+                case 'D': // Describe portal
+                    if (!failed)
+                        AppendMessage(out, 'n', "");
+                    break;
+                case 'E': // Execute
+                    if (!failed)
+                    {
+                        AppendMessage(out, 'C', std::string("INSERT 0 1\0", 11));
+                        ++_executed;
+                    }
+                    break;
+                case 'S': // Sync
+                    failed = false;
+                    ++_syncs;
+                    AppendMessage(out, 'Z', "I");
+                    break;
+                case 'X': // Terminate
+                    return;
+                default:
+                    break;
+                }
+                if (!out.empty() && !Send(client, out))
+                    return;
+            }
+        }
+
+        // Bind: portal, statement, format codes, then parameters as int32 length + value
+        static std::string FirstParam(const std::string& body)
+        {
+            size_t pos = body.find('\0') + 1;
+            pos = body.find('\0', pos) + 1;
+            uint16_t formats = static_cast<uint16_t>((static_cast<uint8_t>(body[pos]) << 8) | static_cast<uint8_t>(body[pos + 1]));
+            pos += 2 + 2 * formats;
+            uint16_t params = static_cast<uint16_t>((static_cast<uint8_t>(body[pos]) << 8) | static_cast<uint8_t>(body[pos + 1]));
+            pos += 2;
+            if (params == 0)
+                return {};
+            uint32_t length = ReadInt32(body.data() + pos);
+            return body.substr(pos + 4, length);
+        }
+
+        static uint32_t ReadInt32(const char* data)
+        {
+            uint32_t value;
+            std::memcpy(&value, data, 4);
+            return ntohl(value);
+        }
+
+        static void AppendMessage(std::string& out, char type, const std::string& body)
+        {
+            uint32_t length = htonl(static_cast<uint32_t>(body.size() + 4));
+            out += type;
+            out.append(reinterpret_cast<const char*>(&length), 4);
+            out += body;
+        }
+
+        static bool ReadExact(int fd, std::string& data, size_t size)
+        {
+            data.resize(size);
+            for (size_t done = 0; done < size; )
+            {
+                ssize_t n = recv(fd, &data[done], size - done, 0);
+                if (n <= 0)
+                    return false;
+                done += static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        static bool Send(int fd, const std::string& data)
+        {
+            for (size_t done = 0; done < data.size(); )
+            {
+                ssize_t n = send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+                if (n <= 0)
+                    return false;
+                done += static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+    private:
+        bool                _eagerReplies;
+        int                 _listen;
+        uint16_t            _port;
+        std::atomic<size_t> _executed{ 0 };
+        std::atomic<size_t> _syncs{ 0 };
+        std::thread         _thread;
+    };
+
+    DBConnectionParams MakeParams(const FakePgServer& server)
+    {
+        DBConnectionParams p;
+        p.dbname = "app_test";
+        p.user = "app_test";
+        p.password = "app_test";
+        p.host = "127.0.0.1";
+        p.port = server.Port();
+        p.timeout = 5;
+        p.async_connections = 1;
+        return p;
+    }
+
+    std::vector<FlagUpdate> MakeUpdates(const std::string& prefix, size_t count)
+    {
+        std::vector<FlagUpdate> updates;
+        for (size_t i = 0; i < count; ++i)
+            updates.push_back({ prefix + std::to_string(i), "flag" + std::to_string(i % 4), true, 1700000000 + i });
+        return updates;
+    }
+} // namespace
+
+TEST(AsyncDB, PipelineCompletes)
+{
+    FakePgServer server;
+    AsyncDB db;
+    db.Connect(MakeParams(server));
+
+    // Large statements: the pipeline doesn't fit the socket buffers, so results
+    // are read by libpq while it flushes the rest of the pipeline
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < 200; ++i)
+        futures.push_back(db.UpdateFlags(MakeUpdates("dev" + std::to_string(i) + "_", 2000)));
+
+    for (auto& future : futures)
+    {
+        ASSERT_EQ(future.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+        EXPECT_NO_THROW(future.get());
+    }
+    EXPECT_EQ(server.Executed(), 200u);
+
+    db.Stop();
+}
+
+TEST(AsyncDB, ReplyReadDuringFlushCompletes)
+{
+    FakePgServer server(true);
+    AsyncDB db;
+    db.Connect(MakeParams(server));
+
+    // A statement larger than the socket buffers: libpq reads its whole reply while flushing it,
+    // after the flush the socket doesn't become readable again
+    auto future = db.UpdateFlags(MakeUpdates("device_with_a_long_name_", 300000));
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    EXPECT_NO_THROW(future.get());
+    EXPECT_EQ(server.Executed(), 1u);
+
+    db.Stop();
+}
+
+TEST(AsyncDB, SmallPipelineCompletes)
+{
+    FakePgServer server;
+    AsyncDB db;
+    db.Connect(MakeParams(server));
+
+    // Replies fit the buffers and may all be read during the flush
+    for (size_t round = 0; round < 50; ++round)
+    {
+        std::vector<std::future<void>> futures;
+        for (size_t i = 0; i < 5; ++i)
+            futures.push_back(db.UpdateFlags(MakeUpdates("dev", 1)));
+        for (auto& future : futures)
+        {
+            ASSERT_EQ(future.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+            EXPECT_NO_THROW(future.get());
+        }
+    }
+    EXPECT_EQ(server.Executed(), 250u);
+
+    db.Stop();
+}
+
+TEST(AsyncDB, SocketAboveFdSetSizeCompletes)
+{
+    // Occupy the low descriptors, the connection socket gets one that select can't wait on
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+    rlimit raised = limit;
+    raised.rlim_cur = std::min<rlim_t>(limit.rlim_max, FD_SETSIZE + 64);
+    if (raised.rlim_cur < FD_SETSIZE + 64 || setrlimit(RLIMIT_NOFILE, &raised) != 0)
+        GTEST_SKIP() << "RLIMIT_NOFILE doesn't allow descriptors above FD_SETSIZE";
+
+    std::vector<int> occupied;
+    for (int fd = dup(0); fd >= 0; fd = dup(0))
+    {
+        occupied.push_back(fd);
+        if (fd >= FD_SETSIZE)
+            break;
+    }
+
+    {
+        FakePgServer server;
+        AsyncDB db;
+        db.Connect(MakeParams(server));
+
+        auto future = db.UpdateFlags(MakeUpdates("dev", 10));
+        ASSERT_EQ(future.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+        EXPECT_NO_THROW(future.get());
+        EXPECT_EQ(server.Executed(), 1u);
+
+        db.Stop();
+    }
+
+    for (int fd : occupied)
+        close(fd);
+    setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+TEST(AsyncDB, FailedStatementDoesNotAbortOthers)
+{
+    FakePgServer server;
+    AsyncDB db;
+    db.Connect(MakeParams(server));
+
+    auto first  = db.UpdateFlags(MakeUpdates("dev", 10));
+    auto failed = db.UpdateFlags(MakeUpdates("fail", 10));
+    auto last   = db.UpdateFlags(MakeUpdates("dev", 10));
+
+    for (auto* future : { &first, &failed, &last })
+        ASSERT_EQ(future->wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    EXPECT_NO_THROW(first.get());
+    EXPECT_THROW(failed.get(), std::runtime_error);
+    EXPECT_NO_THROW(last.get());
+    EXPECT_EQ(server.Executed(), 2u);
+    EXPECT_EQ(server.Syncs(), 4u); // PQprepare at connect and one per statement
+
+    db.Stop();
+}
+
+#endif // !_WIN32
\ No newline at end of file
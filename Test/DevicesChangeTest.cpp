@@ -0,0 +1,41 @@
+﻿#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "DB.h"
+
+using namespace app;
+
+TEST(DevicesChange, PayloadRoundTrip)
+{
+    DevicesChange change{ "instance0", DevicesChange::Op::Create, { "dev0", "dev\"1\\\\" } };
+    auto parsed = ParseDevicesChange(ToPayload(change));
+    EXPECT_EQ(parsed.instance, change.instance);
+    EXPECT_EQ(parsed.op, change.op);
+    EXPECT_EQ(parsed.deviceNames, change.deviceNames);
+
+    parsed = ParseDevicesChange(ToPayload({ "instance0", DevicesChange::Op::DeleteAll, {} }));
+    EXPECT_EQ(parsed.op, DevicesChange::Op::DeleteAll);
+    EXPECT_TRUE(parsed.deviceNames.empty());
+}
+
+TEST(DevicesChange, LargeChangeBecomesSync)
+{
+    std::vector<std::string> deviceNames(1000, "device_with_a_long_name");
+    auto payload = ToPayload({ "instance0", DevicesChange::Op::Delete, deviceNames });
+    EXPECT_LT(payload.size(), 8000u);
+
+    auto parsed = ParseDevicesChange(payload);
+    EXPECT_EQ(parsed.instance, "instance0");
+    EXPECT_EQ(parsed.op, DevicesChange::Op::Sync);
+    EXPECT_TRUE(parsed.deviceNames.empty());
+}
+
+TEST(DevicesChange, MalformedPayload)
+{
+    EXPECT_ANY_THROW(ParseDevicesChange("not json"));
+    EXPECT_ANY_THROW(ParseDevicesChange(R"({"op":"create"})"));
+    EXPECT_THROW(ParseDevicesChange(R"({"instance":"i","op":"rename"})"), std::invalid_argument);
+}
\ No newline at end of file
@@ -0,0 +1,125 @@
+﻿#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "DevParamParser.h"
+
+using namespace app;
+
+namespace
+{
+    struct Param
+    {
+        std::string devName;
+        int paramId;
+        int paramValue;
+
+        bool operator==(const Param& other) const
+        {
+            return devName == other.devName && paramId == other.paramId && paramValue == other.paramValue;
+        }
+    };
+
+    void PrintTo(const Param& p, std::ostream* os)
+    {
+        *os << "{" << p.devName << ", " << p.paramId << ", " << p.paramValue << "}";
+    }
+
+    std::vector<Param> Parse(const std::string& payload, bool* hasError = nullptr)
+    {
+        DevParamParser parser(payload.data(), payload.size());
+        DevParamParser::Item item;
+        std::vector<Param> params;
+        while (parser.Next(item))
+            params.push_back({ std::string(item.devName, item.devNameSize), item.paramId, item.paramValue });
+        if (hasError)
+            *hasError = parser.HasError();
+        return params;
+    }
+} // namespace
+
+TEST(DevParamParser, ValidObject)
+{
+    bool hasError;
+    auto params = Parse(R"({"dev_eui":"dev0","param_id":1,"value":5})", &hasError);
+    EXPECT_FALSE(hasError);
+    EXPECT_EQ(params, (std::vector<Param>{ { "dev0", 1, 5 } }));
+}
+
+TEST(DevParamParser, ValidArray)
+{
+    bool hasError;
+    auto params = Parse(R"([{"dev_eui":"dev0","param_id":1,"value":5},{"value":-7,"dev_eui":"dev1","extra":[1,{"a":"]"}],"param_id":2}])", &hasError);
+    EXPECT_FALSE(hasError);
+    EXPECT_EQ(params, (std::vector<Param>{ { "dev0", 1, 5 }, { "dev1", 2, -7 } }));
+}
+
+TEST(DevParamParser, FloatValueIsTruncated)
+{
+    bool hasError;
+    auto params = Parse(R"([{"dev_eui":"dev0","param_id":1,"value":12.7},{"dev_eui":"dev1","param_id":2.0,"value":-3.9},{"dev_eui":"dev2","param_id":3,"value":1e3}])", &hasError);
+    EXPECT_FALSE(hasError);
+    EXPECT_EQ(params, (std::vector<Param>{ { "dev0", 1, 12 }, { "dev1", 2, -3 }, { "dev2", 3, 1 } }));
+}
+
+TEST(DevParamParser, NonNumericValueSkipsObject)
+{
+    bool hasError;
+    auto params = Parse(R"([{"dev_eui":"dev0","param_id":1,"value":"5"},{"dev_eui":"dev1","param_id":1,"value":true},{"dev_eui":"dev2","param_id":1,"value":99999999999}])", &hasError);
+    EXPECT_FALSE(hasError);
+    EXPECT_TRUE(params.empty());
+}
+
+TEST(DevParamParser, EscapedName)
+{
+    bool hasError;
+    auto params = Parse(R"([{"dev_eui":"dev\"0\\","param_id":1,"value":1},{"dev_eui":"dev\u0031\/x","param_id":1,"value":2},{"dev_eui":"\u00e9\ud83d\ude00","param_id":1,"value":3}])", &hasError);
+    EXPECT_FALSE(hasError);
+    EXPECT_EQ(params, (std::vector<Param>{ { "dev\"0\\", 1, 1 }, { "dev1/x", 1, 2 }, { "\xC3\xA9\xF0\x9F\x98\x80", 1, 3 } }));
+}
+
+TEST(DevParamParser, InvalidEscapeSkipsObject)
+{
+    bool hasError;
+    auto params = Parse(R"([{"dev_eui":"dev\q","param_id":1,"value":1},{"dev_eui":"\ud83d","param_id":1,"value":2},{"dev_eui":"dev1","param_id":1,"value":3}])", &hasError);
+    EXPECT_FALSE(hasError);
+    EXPECT_EQ(params, (std::vector<Param>{ { "dev1", 1, 3 } }));
+}
+
+TEST(DevParamParser, TruncatedPayload)
+{
+    // Objects complete before the cut are delivered, then the parser reports an error
+    const std::string payload = R"([{"dev_eui":"dev0","param_id":1,"value":5},{"dev_eui":"dev1","param_id":2,"value":67}])";
+    const std::vector<Param> expected = { { "dev0", 1, 5 }, { "dev1", 2, 67 } };
+    const size_t firstEnd = payload.find('}') + 1;
+    for (size_t size = 1; size < payload.size(); ++size)
+    {
+        bool hasError;
+        auto params = Parse(payload.substr(0, size), &hasError);
+        EXPECT_TRUE(hasError) << "size " << size;
+        size_t complete = size < firstEnd ? 0 : size < payload.size() - 1 ? 1 : 2;
+        EXPECT_EQ(params, std::vector<Param>(expected.begin(), expected.begin() + complete)) << "size " << size;
+    }
+}
+
+TEST(DevParamParser, Whitespace)
+{
+    bool hasError;
+    auto params = Parse(" \r\n[ \t{ \"dev_eui\" :\t\"dev0\" ,\n\"param_id\" : 1 , \"value\"\r\n:\n5 } ,\n{\"dev_eui\":\"dev1\",\"param_id\":2,\"value\":6}\t]\n", &hasError);
+    EXPECT_FALSE(hasError);
+    EXPECT_EQ(params, (std::vector<Param>{ { "dev0", 1, 5 }, { "dev1", 2, 6 } }));
+}
+
+TEST(DevParamParser, EmptyAndNulTerminated)
+{
+    bool hasError;
+    EXPECT_TRUE(Parse("", &hasError).empty());
+    EXPECT_FALSE(hasError);
+    EXPECT_TRUE(Parse("[ ]", &hasError).empty());
+    EXPECT_FALSE(hasError);
+
+    const std::string payload("{\"dev_eui\":\"dev0\",\"param_id\":1,\"value\":5}\0", 43);
+    EXPECT_EQ(Parse(payload, &hasError), (std::vector<Param>{ { "dev0", 1, 5 } }));
+    EXPECT_FALSE(hasError);
+}
\ No newline at end of file